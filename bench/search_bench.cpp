@@ -0,0 +1,108 @@
+// Micro-benchmark: LiteralSearcher (mysearch.h) against std::string::find.
+//
+// Build: g++ -std=c++17 -O1 -I. bench/search_bench.cpp -o bench/search_bench
+// Usage: bench/search_bench <corpus-file> <pattern...>
+//
+// Each pattern is searched the way mygrep does it: line by line, stopping at
+// the first hit (line filter), and over the whole corpus collecting every
+// non-overlapping occurrence (-o / coloring). Both engines must agree.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
+#include "mysearch.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Run fn until at least 200 ms have passed; return the best MB/s of the rounds.
+template <typename Fn>
+static double throughput(size_t bytes, Fn fn, size_t &result) {
+    double best = 0;
+    auto start = Clock::now();
+    do {
+        auto t0 = Clock::now();
+        result = fn();
+        double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+        if (secs > 0) best = std::max(best, bytes / secs / 1e6);
+    } while (Clock::now() - start < std::chrono::milliseconds(200));
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <corpus-file> <pattern...>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "Error: Could not open file " << argv[1] << std::endl;
+        return 1;
+    }
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    const std::string corpus = ss.str();
+
+    std::vector<std::string> lines;
+    std::istringstream ls(corpus);
+    for (std::string line; std::getline(ls, line);) lines.push_back(line);
+
+    std::cout << "corpus: " << corpus.size() << " bytes, " << lines.size() << " lines\n"
+              << std::left << std::setw(24) << "pattern" << std::setw(18) << "engine"
+              << std::right << std::setw(14) << "lines MB/s" << std::setw(14) << "all MB/s"
+              << std::setw(12) << "hits" << '\n';
+
+    int status = 0;
+    for (int k = 2; k < argc; ++k) {
+        const std::string pattern = argv[k];
+        const LiteralSearcher searcher(pattern);
+
+        size_t std_lines, std_all, lit_lines, lit_all;
+        double std_lines_mbs = throughput(corpus.size(), [&] {
+            size_t hits = 0;
+            for (const auto &line : lines) hits += line.find(pattern) != std::string::npos;
+            return hits;
+        }, std_lines);
+        double std_all_mbs = throughput(corpus.size(), [&] {
+            size_t hits = 0;
+            for (size_t pos = corpus.find(pattern); pos != std::string::npos;
+                 pos = corpus.find(pattern, pos + pattern.size())) {
+                ++hits;
+            }
+            return hits;
+        }, std_all);
+        double lit_lines_mbs = throughput(corpus.size(), [&] {
+            size_t hits = 0;
+            for (const auto &line : lines) hits += searcher.find(line) != LiteralSearcher::npos;
+            return hits;
+        }, lit_lines);
+        double lit_all_mbs = throughput(corpus.size(), [&] {
+            size_t hits = 0;
+            for (size_t pos = searcher.find(corpus); pos != LiteralSearcher::npos;
+                 pos = searcher.find(corpus, pos + pattern.size())) {
+                ++hits;
+            }
+            return hits;
+        }, lit_all);
+
+        std::string shown = pattern.size() > 22 ? pattern.substr(0, 19) + "..." : pattern;
+        std::cout << std::fixed << std::setprecision(0)
+                  << std::left << std::setw(24) << shown << std::setw(18) << "std::string::find"
+                  << std::right << std::setw(14) << std_lines_mbs << std::setw(14) << std_all_mbs
+                  << std::setw(12) << std_all << '\n'
+                  << std::left << std::setw(24) << "" << std::setw(18) << searcher.algorithm_name()
+                  << std::right << std::setw(14) << lit_lines_mbs << std::setw(14) << lit_all_mbs
+                  << std::setw(12) << lit_all << '\n';
+
+        if (std_lines != lit_lines || std_all != lit_all) {
+            std::cerr << "Error: results differ for pattern " << pattern << std::endl;
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -1,7 +1,214 @@
 #include <iostream>
-#include <fstream>
+#include <cstring>
 #include <string>
+#include <vector>
 #include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/inotify.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <csignal>
+#include "myio.h"
+#include "myuring.h"
+#include "mysimd.h"
+
+// Line number kept as ASCII text and incremented in place, so numbering
+// never goes through an integer-to-string conversion.
+class LineCounter {
+public:
+    LineCounter() : start_(sizeof(digits_) - 1) { digits_[start_] = '1'; }
+
+    void increment() {
+        size_t k = sizeof(digits_) - 1;
+        while (digits_[k] == '9') {
+            digits_[k] = '0';
+            if (k == start_) { // 99 -> 100: grow one digit to the left
+                digits_[--start_] = '1';
+                return;
+            }
+            --k;
+        }
+        ++digits_[k];
+    }
+
+    const char *data() const { return digits_ + start_; }
+    size_t size() const { return sizeof(digits_) - start_; }
+
+private:
+    char digits_[24];
+    size_t start_; // index of the most significant digit
+};
+
+// Options that make mycat look at line boundaries
+struct CatOptions {
+    bool number = false;          // -n
+    bool number_nonblank = false; // -b
+    bool squeeze = false;         // -s
+    bool show_nonprinting = false; // -v
+    bool show_tabs = false;       // -T
+    bool show_ends = false;       // -E
+};
+
+// What one byte turns into under -v/-T (e.g. "^I", "M-^A")
+struct ByteExpansion {
+    char text[4];
+    unsigned char len;
+};
+
+// -v/-T display: runs of bytes that are shown as-is are found with a vectorized
+// scan and copied in bulk; only the exceptional bytes go through a lookup table.
+class DisplayEncoder {
+public:
+    explicit DisplayEncoder(const CatOptions &opts);
+
+    void write(OutputWriter &w, const char *p, size_t n) const;
+
+private:
+    size_t plain_run(const char *p, size_t n) const;
+
+    ByteExpansion table_[256];
+    bool nonprinting_;
+    bool tabs_;
+    size_t (*scan_)(const char *p, size_t n, bool tab_plain); // SIMD kernel for -v
+};
+
+// Block-oriented line engine for -n/-b/-s/-v/-T/-E: input arrives in arbitrary
+// blocks, newlines are located with memchr and untouched spans go to the writer as-is.
+// State survives across feed() calls, so lines may straddle blocks.
+class LineEngine {
+public:
+    LineEngine(const CatOptions &opts, OutputWriter &w)
+        : opts_(opts), w_(w), encoder_(opts),
+          raw_(!opts.show_nonprinting && !opts.show_tabs && !opts.show_ends) {}
+
+    void feed(const char *data, size_t n);
+    void finish(); // terminate an unterminated last line, like getline did
+
+private:
+    void prefix(bool blank);
+    void content(const char *p, size_t n); // line bytes without the '\n'
+    void end_line();
+
+    const CatOptions &opts_;
+    OutputWriter &w_;
+    DisplayEncoder encoder_;
+    bool raw_; // no -v/-T/-E: spans are written untouched
+    LineCounter counter_;
+    bool at_line_start_ = true;
+    bool prev_blank_ = false; // last emitted line was blank (for -s)
+};
+
+// A file opened, and if small enough fully read, ahead of the main loop
+struct PrefetchedFile {
+    int fd = -1;                // -1 when the open failed
+    const char *data = nullptr; // bytes read from offset 0
+    size_t len = 0;
+    bool complete = false;      // data holds the whole file
+    bool deferred = false;      // not a regular file: opened by next(), in argument order
+};
+
+// Opens and reads files in batches ahead of the main loop and hands them out in
+// argument order. Batches go through io_uring (statx, then openat, then read)
+// when the kernel allows it, or through a few worker threads otherwise. Only
+// regular files are opened ahead: a FIFO or device may block or be consumed
+// by the open, so it is opened when its turn comes. Without batching it just
+// opens each file when asked.
+class FilePrefetcher {
+public:
+    FilePrefetcher(char **paths, size_t count, bool batch);
+    ~FilePrefetcher();
+
+    // Next file in argument order; the previous one is closed by the prefetcher.
+    PrefetchedFile &next();
+
+private:
+    static const size_t WINDOW = 64;         // files per batch
+    static const size_t HEAD_SIZE = 1 << 16; // bytes prefetched per file
+
+    void load_window(size_t start);
+    bool load_window_uring(size_t start, size_t n);
+    void load_window_threads(size_t start, size_t n);
+    void fill_slot(size_t k, size_t file); // blocking stat, then open + fstat + pread
+    void worker();
+    void close_window();
+
+    char **paths_;
+    size_t count_;
+    bool batch_;
+    size_t pos_ = 0;          // next file to hand out
+    size_t window_start_ = 0;
+    size_t window_len_ = 0;
+    std::vector<PrefetchedFile> slots_;
+    std::vector<char> heads_; // WINDOW * HEAD_SIZE bytes
+
+    IoUring ring_;
+    bool use_uring_ = false;
+    std::vector<struct statx> stx_;
+
+    // worker pool for the fallback
+    std::vector<std::thread> workers_;
+    std::mutex mu_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    size_t job_start_ = 0;
+    size_t job_count_ = 0;
+    size_t job_claimed_ = 0;
+    size_t job_done_ = 0;
+    bool stop_ = false;
+};
+
+// -f: after the first pass, waits for inotify events in one epoll loop and
+// prints only the bytes appended since the last read of each file. A rotated
+// (moved or deleted) file keeps being read until a new file appears under the
+// same name, which is then printed from the start; a truncated file is read
+// again from the start.
+class Follower {
+public:
+    Follower(const CatOptions &opts, bool fast_path) : opts_(opts), fast_path_(fast_path) {}
+    ~Follower();
+
+    // Print what fd holds so far and keep following it (regular files only).
+    bool add(const char *path, int fd);
+    bool empty() const { return files_.empty(); }
+
+    int run(); // returns only on error or SIGINT/SIGTERM
+
+private:
+    struct FollowedFile {
+        std::string path;
+        std::string name;  // last path component, matched against directory events
+        int fd = -1;
+        int wd = -1;       // watch on the file itself
+        int dir_wd = -1;   // watch on its directory, for re-creation
+        bool rotated = false; // moved or unlinked: still read until the name comes back
+        std::unique_ptr<LineEngine> engine; // null in the fast path
+    };
+
+    bool drain(FollowedFile &f);
+    void watch(size_t idx);
+    void unwatch(size_t idx);
+    void switch_if_replaced(size_t idx);
+
+    const CatOptions &opts_;
+    bool fast_path_;
+    std::vector<FollowedFile> files_;
+    int inotify_fd_ = -1;
+    std::unordered_map<int, std::vector<size_t>> file_watches_;
+    std::unordered_map<int, std::vector<size_t>> dir_watches_;
+};
+
+bool copy_file_fast(int in_fd, int out_fd, char &last);
+bool cat_lines(int fd, LineEngine &engine);
+bool cat_file(PrefetchedFile &file, const CatOptions &opts, bool fast_path);
 
 int main(int argc, char *argv[]) {
     // Check for at least one file argument
@@ -15,7 +222,12 @@ int main(int argc, char *argv[]) {
         {"--help", false}, // Display help information
         {"-n", false}, // Number all output lines
         {"-b", false}, // Number non-blank output lines
-        {"-s", false} // Squeeze multiple adjacent blank lines
+        {"-s", false}, // Squeeze multiple adjacent blank lines
+        {"-v", false}, // Show non-printing characters with ^ and M- notation
+        {"-T", false}, // Show TAB characters as ^I
+        {"-E", false}, // Show $ at end of each line
+        {"-A", false}, // Equivalent to -vET
+        {"-f", false} // Keep following the files as they grow
     };
 
     size_t i = 1;
@@ -30,7 +242,12 @@ int main(int argc, char *argv[]) {
                           << "  --help    Display this help information\n"
                           << "  -n        Number all output lines\n"
                           << "  -b        Number non-blank output lines\n"
-                          << "  -s        Squeeze multiple adjacent blank lines\n";
+                          << "  -s        Squeeze multiple adjacent blank lines\n"
+                          << "  -v        Use ^ and M- notation, except for LFD and TAB\n"
+                          << "  -T        Display TAB characters as ^I\n"
+                          << "  -E        Display $ at end of each line\n"
+                          << "  -A        Equivalent to -vET\n"
+                          << "  -f        Output appended data as the files grow\n";
                 return 0;
 
             } else {
@@ -51,53 +268,821 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    for ( ; i < argc ; ++i) { // Process each file from the remaining arguments
-        size_t line_number = 1; // counter for line number
+    CatOptions cat_opts;
+    cat_opts.number = options["-n"];
+    cat_opts.number_nonblank = options["-b"];
+    cat_opts.squeeze = options["-s"];
+    cat_opts.show_nonprinting = options["-v"] || options["-A"];
+    cat_opts.show_tabs = options["-T"] || options["-A"];
+    cat_opts.show_ends = options["-E"] || options["-A"];
+
+    // no line options: let the kernel move the bytes
+    bool fast_path = !cat_opts.number && !cat_opts.number_nonblank && !cat_opts.squeeze &&
+                     !cat_opts.show_nonprinting && !cat_opts.show_tabs && !cat_opts.show_ends;
 
-        std::ifstream infile(argv[i]);
-        if (!infile) {
+    // many small files: open and read them in batches instead of one by one
+    // (not with -f, which keeps every file open at its read offset)
+    const size_t BATCH_MIN_FILES = 8;
+    bool follow = options["-f"];
+    FilePrefetcher prefetcher(argv + i, argc - i, !follow && argc - i >= BATCH_MIN_FILES);
+    Follower follower(cat_opts, fast_path);
+
+    for ( ; i < argc ; ++i) { // Process each file from the remaining arguments
+        PrefetchedFile &file = prefetcher.next();
+        if (file.fd == -1) {
             std::cerr << "Error: Could not open file " << argv[i] << std::endl;
             continue;
         }
 
-        // sign for squeezing blank lines
-        bool squeeze_blank_lines = false;
+        bool ok = follow ? follower.add(argv[i], file.fd) : cat_file(file, cat_opts, fast_path);
+        if (!ok) {
+            std::cerr << "Error: Could not read file " << argv[i] << std::endl;
+        }
 
-        std::string line;
-        while (std::getline(infile, line)) {
+        // Print a newline between files if there are multiple files
+        if (argc > 2 && i < argc - 1) {
+            out() << '\n';
+        }
+    }
 
-            // Handle options here in the future
+    if (follow && !follower.empty()) {
+        return follower.run();
+    }
+    return 0;
+}
 
-            if (options["-s"] == true) {
-                if (line.empty()) {
-                    if (squeeze_blank_lines == true) {
-                        continue; // Skip this line
-                    } else {
-                        squeeze_blank_lines = true; // Mark that we've seen a blank line
-                    }
-                } else {
-                    squeeze_blank_lines = false; // Reset on non-blank line
-                }
+// write all of buf to fd, retrying on short writes
+static bool write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        buf += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Copy the rest of in_fd (from its current offset) to out_fd, preferring
+// in-kernel copies: copy_file_range/sendfile when out_fd is a regular file,
+// splice when it is a pipe, and a large read/write loop otherwise (or when the
+// kernel refuses). last is set to the last byte copied, if any.
+bool copy_file_fast(int in_fd, int out_fd, char &last) {
+    const size_t CHUNK = 1 << 30; // per-call cap for the kernel copies
+
+    struct stat in_st, out_st;
+    if (fstat(in_fd, &in_st) != 0 || fstat(out_fd, &out_st) != 0) {
+        return false;
+    }
+    posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    off_t start = S_ISREG(in_st.st_mode) ? lseek(in_fd, 0, SEEK_CUR) : 0;
+    off_t copied = 0;
+    bool eof = false;
+
+    if (S_ISREG(in_st.st_mode)) {
+        if (S_ISREG(out_st.st_mode)) {
+            // same-filesystem copies may be reflinked or done server side
+            while (true) {
+                ssize_t n = copy_file_range(in_fd, nullptr, out_fd, nullptr, CHUNK, 0);
+                if (n > 0) { copied += n; continue; }
+                if (n == 0) { eof = true; break; }
+                if (errno == EINTR) continue;
+                break; // EXDEV, EINVAL, ENOSYS...: try sendfile
+            }
+            while (!eof) {
+                ssize_t n = sendfile(out_fd, in_fd, nullptr, CHUNK);
+                if (n > 0) { copied += n; continue; }
+                if (n == 0) { eof = true; break; }
+                if (errno == EINTR) continue;
+                break;
             }
+        } else if (S_ISFIFO(out_st.st_mode)) {
+            while (true) {
+                ssize_t n = splice(in_fd, nullptr, out_fd, nullptr, CHUNK, SPLICE_F_MORE);
+                if (n > 0) { copied += n; continue; }
+                if (n == 0) { eof = true; break; }
+                if (errno == EINTR) continue;
+                break;
+            }
+        }
+    }
 
-            if (options["-n"] == true || options["-b"] == true) {
-                if (options["-b"] == true && line.empty()) {
-                    std::cout << "\t"; // No line number for blank lines
-                } else {
-                    std::cout << line_number++ << "\t";
+    // fallback: plain read/write through one large buffer
+    static std::vector<char> buf(1 << 17);
+    if (!eof) {
+        while (true) {
+            ssize_t n = read(in_fd, buf.data(), buf.size());
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (n == 0) break;
+            if (!write_all(out_fd, buf.data(), static_cast<size_t>(n))) return false;
+            last = buf[n - 1];
+            copied += n;
+        }
+    } else if (copied > 0 && pread(in_fd, &last, 1, start + copied - 1) != 1) {
+        last = '\n';
+    }
+    return true;
+}
+
+// Feed the rest of fd (from its current offset) to the line engine in large blocks.
+bool cat_lines(int fd, LineEngine &engine) {
+    static std::vector<char> buf(1 << 17);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    bool may_block = input_may_block(fd);
+
+    while (true) {
+        if (may_block) out().flush(); // lines already read must not wait for a slow producer
+        ssize_t n = read(fd, buf.data(), buf.size());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) break;
+        engine.feed(buf.data(), static_cast<size_t>(n));
+    }
+    return true;
+}
+
+// Output one open file: the prefetched head first, then whatever is left.
+// Like the getline path, a final line without '\n' still gets one.
+bool cat_file(PrefetchedFile &file, const CatOptions &opts, bool fast_path) {
+    if (!file.complete && file.len > 0) {
+        // the head was read with pread semantics; continue after it
+        // (fails harmlessly for pipes, where the bytes are already consumed)
+        lseek(file.fd, static_cast<off_t>(file.len), SEEK_SET);
+    }
+
+    bool ok = true;
+    if (fast_path) {
+        char last = '\n';
+        if (file.len > 0) {
+            out().write(file.data, file.len);
+            last = file.data[file.len - 1];
+        }
+        if (!file.complete) {
+            out().flush(); // keep ordering with anything already buffered
+            ok = copy_file_fast(file.fd, STDOUT_FILENO, last);
+        }
+        if (last != '\n') {
+            out() << '\n';
+        }
+        return ok;
+    }
+
+    LineEngine engine(opts, out());
+    if (file.len > 0) {
+        engine.feed(file.data, file.len);
+    }
+    if (!file.complete) {
+        ok = cat_lines(file.fd, engine);
+    }
+    engine.finish();
+    return ok;
+}
+
+// Line number prefix for the line about to be written
+void LineEngine::prefix(bool blank) {
+    if (opts_.number_nonblank) {
+        if (blank) {
+            w_.put('\t'); // No line number for blank lines
+            return;
+        }
+    } else if (!opts_.number) {
+        return;
+    }
+    w_.write(counter_.data(), counter_.size());
+    w_.put('\t');
+    counter_.increment();
+}
+
+void LineEngine::feed(const char *data, size_t n) {
+    const char *p = data;
+    const char *end = data + n;
+    bool numbering = opts_.number || opts_.number_nonblank;
+
+    while (p < end) {
+        if (at_line_start_) {
+            if (*p == '\n') { // blank line
+                if (opts_.squeeze && prev_blank_) {
+                    // skip the whole run of extra blank lines at once
+                    while (p < end && *p == '\n') ++p;
+                    continue;
                 }
+                prefix(true);
+                end_line();
+                prev_blank_ = true;
+                ++p;
+                continue;
             }
+            prefix(false);
+            prev_blank_ = false;
+            at_line_start_ = false;
+        }
 
-            // ending options handling
+        // inside a non-blank line: find where it ends
+        const char *nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (nl == nullptr) { // line continues in the next block
+            content(p, static_cast<size_t>(end - p));
+            return;
+        }
 
-            std::cout << line << std::endl;
+        if (!raw_) {
+            content(p, static_cast<size_t>(nl - p));
+            end_line();
+            p = nl + 1;
+            at_line_start_ = true;
+            continue;
         }
-        infile.close();
 
-        // Print a newline between files if there are multiple files
-        if (argc > 2 && i < argc - 1) {
-            std::cout << std::endl;
+        if (!numbering) {
+            // only -s: extend the span over following non-blank lines, so it
+            // is cut only where a blank line starts
+            while (nl + 1 < end && nl[1] != '\n') {
+                const char *next = static_cast<const char*>(
+                    std::memchr(nl + 1, '\n', static_cast<size_t>(end - nl - 1)));
+                if (next == nullptr) break;
+                nl = next;
+            }
+            if (nl + 1 < end && nl[1] != '\n') { // an unterminated line follows
+                w_.write(p, static_cast<size_t>(end - p));
+                return;
+            }
+        }
+
+        w_.write(p, static_cast<size_t>(nl + 1 - p));
+        p = nl + 1;
+        at_line_start_ = true;
+    }
+}
+
+void LineEngine::content(const char *p, size_t n) {
+    if (raw_ || !(opts_.show_nonprinting || opts_.show_tabs)) {
+        w_.write(p, n);
+    } else {
+        encoder_.write(w_, p, n);
+    }
+}
+
+void LineEngine::end_line() {
+    if (opts_.show_ends) {
+        w_.put('$');
+    }
+    w_.put('\n');
+}
+
+void LineEngine::finish() {
+    if (!at_line_start_) {
+        end_line();
+        at_line_start_ = true;
+        prev_blank_ = false;
+    }
+}
+
+// Length of the leading run of bytes that -v shows as-is: printable ASCII,
+// plus TAB unless -T is set.
+static size_t plain_run_scalar(const char *p, size_t n, bool tab_plain) {
+    for (size_t k = 0; k < n; ++k) {
+        unsigned char c = static_cast<unsigned char>(p[k]);
+        if ((c < 0x20 || c >= 0x7F) && !(tab_plain && c == '\t')) return k;
+    }
+    return n;
+}
+
+#if MY_X86
+// Signed compares do the classification: 0x80..0xFF are negative and fail "> 0x1F".
+static size_t plain_run_sse2(const char *p, size_t n, bool tab_plain) {
+    const __m128i lo = _mm_set1_epi8(0x1F);
+    const __m128i hi = _mm_set1_epi8(0x7F);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i tab_ok = tab_plain ? _mm_set1_epi8(-1) : _mm_setzero_si128();
+
+    size_t k = 0;
+    for (; k + 16 <= n; k += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k));
+        __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+        ok = _mm_or_si128(ok, _mm_and_si128(_mm_cmpeq_epi8(v, tab), tab_ok));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(ok));
+        if (mask != 0xFFFF) return k + static_cast<size_t>(__builtin_ctz(~mask));
+    }
+    return k + plain_run_scalar(p + k, n - k, tab_plain);
+}
+
+MY_TARGET_AVX2
+static size_t plain_run_avx2(const char *p, size_t n, bool tab_plain) {
+    const __m256i lo = _mm256_set1_epi8(0x1F);
+    const __m256i hi = _mm256_set1_epi8(0x7F);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i tab_ok = tab_plain ? _mm256_set1_epi8(-1) : _mm256_setzero_si256();
+
+    size_t k = 0;
+    for (; k + 32 <= n; k += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + k));
+        __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(v, lo), _mm256_cmpgt_epi8(hi, v));
+        ok = _mm256_or_si256(ok, _mm256_and_si256(_mm256_cmpeq_epi8(v, tab), tab_ok));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(ok));
+        if (mask != 0xFFFFFFFFu) {
+            _mm256_zeroupper(); // avoid AVX/SSE transition stalls in the caller
+            return k + static_cast<size_t>(__builtin_ctz(~mask));
+        }
+    }
+    _mm256_zeroupper();
+    return k + plain_run_sse2(p + k, n - k, tab_plain);
+}
+#endif
+
+DisplayEncoder::DisplayEncoder(const CatOptions &opts)
+    : nonprinting_(opts.show_nonprinting), tabs_(opts.show_tabs), scan_(plain_run_scalar) {
+#if MY_X86
+    scan_ = cpu_has_avx2() ? plain_run_avx2 : plain_run_sse2;
+#endif
+
+    for (int c = 0; c < 256; ++c) {
+        ByteExpansion &e = table_[c];
+        e.len = 0;
+        int v = c;
+        if (nonprinting_) {
+            if (v >= 128) { // meta: M- and then the low 7 bits
+                e.text[e.len++] = 'M';
+                e.text[e.len++] = '-';
+                v -= 128;
+            }
+            if (v == '\t' && e.len == 0) {
+                // plain TAB stays unless -T; handled below
+            } else if (v < 32) {
+                e.text[e.len++] = '^';
+                v += 64;
+            } else if (v == 127) {
+                e.text[e.len++] = '^';
+                v = '?';
+            }
+        }
+        if (c == '\t' && tabs_) {
+            e.text[e.len++] = '^';
+            v = 'I';
+        }
+        e.text[e.len++] = static_cast<char>(v);
+    }
+}
+
+size_t DisplayEncoder::plain_run(const char *p, size_t n) const {
+    if (!nonprinting_) { // -T alone: TAB is the only byte to expand
+        const void *tab = std::memchr(p, '\t', n);
+        return tab == nullptr ? n : static_cast<size_t>(static_cast<const char*>(tab) - p);
+    }
+    return scan_(p, n, !tabs_);
+}
+
+void DisplayEncoder::write(OutputWriter &w, const char *p, size_t n) const {
+    const char *end = p + n;
+    while (p < end) {
+        size_t run = plain_run(p, static_cast<size_t>(end - p));
+        w.write(p, run);
+        p += run;
+
+        // expand exceptional bytes until the next plain one
+        while (p < end) {
+            const ByteExpansion &e = table_[static_cast<unsigned char>(*p)];
+            if (e.len == 1 && e.text[0] == *p) break;
+            w.write(e.text, e.len);
+            ++p;
+        }
+    }
+}
+
+FilePrefetcher::FilePrefetcher(char **paths, size_t count, bool batch)
+    : paths_(paths), count_(count), batch_(batch), slots_(WINDOW) {
+    if (!batch_) return;
+
+    heads_.resize(WINDOW * HEAD_SIZE);
+    stx_.resize(WINDOW);
+    use_uring_ = ring_.init(4 * WINDOW); // room for a window of closes + stats + opens
+}
+
+FilePrefetcher::~FilePrefetcher() {
+    close_window();
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto &t : workers_) t.join();
+}
+
+PrefetchedFile &FilePrefetcher::next() {
+    if (!batch_) {
+        close_window();
+        PrefetchedFile &file = slots_[0];
+        file = PrefetchedFile();
+        file.fd = open(paths_[pos_++], O_RDONLY | O_CLOEXEC);
+        window_len_ = 1;
+        return file;
+    }
+
+    if (pos_ >= window_start_ + window_len_) {
+        load_window(pos_);
+    }
+    PrefetchedFile &file = slots_[pos_ - window_start_];
+    if (file.deferred) {
+        file.fd = open(paths_[pos_], O_RDONLY | O_CLOEXEC);
+    }
+    ++pos_;
+    return file;
+}
+
+void FilePrefetcher::close_window() {
+    for (size_t k = 0; k < window_len_; ++k) {
+        if (slots_[k].fd >= 0) close(slots_[k].fd);
+        slots_[k] = PrefetchedFile();
+    }
+    window_len_ = 0;
+}
+
+void FilePrefetcher::load_window(size_t start) {
+    size_t n = std::min(WINDOW, count_ - start);
+
+    if (use_uring_ && !load_window_uring(start, n)) {
+        use_uring_ = false; // e.g. kernel without IORING_OP_OPENAT
+    }
+    if (!use_uring_) {
+        close_window();
+        load_window_threads(start, n);
+    }
+    window_start_ = start;
+    window_len_ = n;
+}
+
+// user_data layout: operation in the high bits, slot index in the low bits
+enum : uint64_t { OP_CLOSE = 1ULL << 32, OP_OPEN = 2ULL << 32, OP_STATX = 3ULL << 32, OP_READ = 4ULL << 32 };
+
+bool FilePrefetcher::load_window_uring(size_t start, size_t n) {
+    uint64_t tag;
+    int res;
+
+    // closes of the previous window travel with the new stats
+    size_t pending = 0;
+    for (size_t k = 0; k < window_len_; ++k) {
+        if (slots_[k].fd >= 0) {
+            ring_.prep_close(slots_[k].fd, OP_CLOSE | k);
+            ++pending;
+        }
+        slots_[k] = PrefetchedFile();
+    }
+    window_len_ = n; // from here on close_window() cleans up this window
+    for (size_t k = 0; k < n; ++k) {
+        ring_.prep_statx(paths_[start + k], STATX_TYPE | STATX_SIZE, &stx_[k], OP_STATX | k);
+        ++pending;
+    }
+    if (ring_.submit(0) < 0) return false;
+
+    std::vector<bool> regular(n, false);
+    bool unsupported = false;
+    for (; pending > 0; --pending) {
+        if (!ring_.wait(tag, res)) return false;
+        if ((tag & ~0xffffffffULL) == OP_STATX) {
+            size_t k = tag & 0xffffffffULL;
+            regular[k] = (res == 0 && S_ISREG(stx_[k].stx_mode));
+            if (res == -EINVAL) unsupported = true;
+        }
+    }
+    if (unsupported) { // e.g. kernel without IORING_OP_STATX
+        return false;
+    }
+
+    // open the regular files; the rest (and failed stats) wait for next()
+    for (size_t k = 0; k < n; ++k) {
+        if (!regular[k]) {
+            slots_[k].deferred = true;
+            continue;
+        }
+        ring_.prep_openat(paths_[start + k], O_RDONLY | O_CLOEXEC, OP_OPEN | k);
+        ++pending;
+    }
+    if (pending > 0 && ring_.submit(0) < 0) return false;
+
+    for (; pending > 0; --pending) {
+        if (!ring_.wait(tag, res)) return false;
+        size_t k = tag & 0xffffffffULL;
+        slots_[k].fd = res >= 0 ? res : -1;
+        if (res == -EINVAL) unsupported = true;
+    }
+    if (unsupported) { // hand the window to the thread fallback
+        return false;
+    }
+
+    // prefetch the head of every small regular file; others are streamed later
+    for (size_t k = 0; k < n; ++k) {
+        PrefetchedFile &file = slots_[k];
+        if (file.fd < 0) continue;
+
+        uint64_t size = stx_[k].stx_size;
+        if (size == 0) {
+            file.complete = true;
+            continue;
+        }
+        file.data = heads_.data() + k * HEAD_SIZE;
+        unsigned want = static_cast<unsigned>(std::min<uint64_t>(size, HEAD_SIZE));
+        ring_.prep_read(file.fd, heads_.data() + k * HEAD_SIZE, want, 0, OP_READ | k);
+        ++pending;
+    }
+    if (pending > 0 && ring_.submit(0) < 0) return false;
+
+    for (; pending > 0; --pending) {
+        if (!ring_.wait(tag, res)) return false;
+        PrefetchedFile &file = slots_[tag & 0xffffffffULL];
+        if (res > 0) {
+            file.len = static_cast<size_t>(res);
+            file.complete = (file.len == stx_[tag & 0xffffffffULL].stx_size);
+        } else {
+            file.data = nullptr; // leave errors to the streaming path
+        }
+    }
+    return true;
+}
+
+void FilePrefetcher::load_window_threads(size_t start, size_t n) {
+    if (workers_.empty()) {
+        unsigned hw = std::thread::hardware_concurrency();
+        size_t count = std::min<size_t>(8, std::max<unsigned>(hw, 2)); // I/O bound: a few more than cores
+        for (size_t t = 0; t < count; ++t) {
+            workers_.emplace_back(&FilePrefetcher::worker, this);
         }
     }
+
+    std::unique_lock<std::mutex> lock(mu_);
+    job_start_ = start;
+    job_count_ = n;
+    job_claimed_ = 0;
+    job_done_ = 0;
+    work_cv_.notify_all();
+    done_cv_.wait(lock, [this] { return job_done_ == job_count_; });
+}
+
+void FilePrefetcher::worker() {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (true) {
+        work_cv_.wait(lock, [this] { return stop_ || job_claimed_ < job_count_; });
+        if (stop_) return;
+
+        size_t k = job_claimed_++;
+        size_t file_index = job_start_ + k;
+        lock.unlock();
+        fill_slot(k, file_index);
+        lock.lock();
+
+        if (++job_done_ == job_count_) done_cv_.notify_one();
+    }
+}
+
+void FilePrefetcher::fill_slot(size_t k, size_t file_index) {
+    PrefetchedFile &file = slots_[k];
+    file = PrefetchedFile();
+
+    struct stat st;
+    if (stat(paths_[file_index], &st) != 0 || !S_ISREG(st.st_mode)) {
+        file.deferred = true;
+        return;
+    }
+    file.fd = open(paths_[file_index], O_RDONLY | O_CLOEXEC);
+    if (file.fd < 0 || fstat(file.fd, &st) != 0 || !S_ISREG(st.st_mode)) return;
+    if (st.st_size == 0) {
+        file.complete = true;
+        return;
+    }
+
+    char *head = heads_.data() + k * HEAD_SIZE;
+    size_t want = std::min<size_t>(static_cast<size_t>(st.st_size), HEAD_SIZE);
+    ssize_t got = pread(file.fd, head, want, 0);
+    if (got > 0) {
+        file.data = head;
+        file.len = static_cast<size_t>(got);
+        file.complete = (got == st.st_size);
+    }
+}
+
+Follower::~Follower() {
+    for (auto &f : files_) {
+        if (f.fd >= 0) close(f.fd);
+    }
+    if (inotify_fd_ >= 0) close(inotify_fd_);
+}
+
+bool Follower::add(const char *path, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return false;
+
+    if (!S_ISREG(st.st_mode)) { // pipes and devices: nothing to follow after EOF
+        PrefetchedFile once;
+        once.fd = fd;
+        return cat_file(once, opts_, fast_path_);
+    }
+
+    FollowedFile f;
+    f.path = path;
+    size_t slash = f.path.rfind('/');
+    f.name = (slash == std::string::npos) ? f.path : f.path.substr(slash + 1);
+    if (!fast_path_) {
+        f.engine.reset(new LineEngine(opts_, out()));
+    }
+
+    f.fd = dup(fd); // the prefetcher closes its own descriptor
+    if (f.fd < 0) return false;
+    files_.push_back(std::move(f));
+    return drain(files_.back());
+}
+
+// Print everything between the current offset and EOF. Unterminated lines are
+// left open: the rest of the line is expected to arrive later.
+bool Follower::drain(FollowedFile &f) {
+    struct stat st;
+    if (fstat(f.fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size < lseek(f.fd, 0, SEEK_CUR)) {
+        lseek(f.fd, 0, SEEK_SET); // truncated in place: start over
+    }
+
+    if (f.engine) {
+        return cat_lines(f.fd, *f.engine);
+    }
+    char last = '\n';
+    out().flush(); // keep ordering with anything already buffered
+    return copy_file_fast(f.fd, STDOUT_FILENO, last);
+}
+
+void Follower::watch(size_t idx) {
+    FollowedFile &f = files_[idx];
+    // IN_ATTRIB reports the unlink while we still hold the file open
+    f.wd = inotify_add_watch(inotify_fd_, f.path.c_str(), IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+    if (f.wd >= 0) {
+        file_watches_[f.wd].push_back(idx);
+    }
+}
+
+void Follower::unwatch(size_t idx) {
+    FollowedFile &f = files_[idx];
+    if (f.wd < 0) return;
+
+    auto &v = file_watches_[f.wd];
+    v.erase(std::remove(v.begin(), v.end(), idx), v.end());
+    if (v.empty()) {
+        inotify_rm_watch(inotify_fd_, f.wd); // fails harmlessly after IN_DELETE_SELF
+        file_watches_.erase(f.wd);
+    }
+    f.wd = -1;
+}
+
+// After a rotation: once a different file exists under the path, finish the
+// old one and continue with the new one from its first byte.
+void Follower::switch_if_replaced(size_t idx) {
+    FollowedFile &f = files_[idx];
+    if (!f.rotated) return;
+
+    int fd = open(f.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return; // not back yet; the directory watch will tell us
+
+    struct stat old_st, new_st;
+    if (fstat(fd, &new_st) != 0 || fstat(f.fd, &old_st) != 0 ||
+        (old_st.st_dev == new_st.st_dev && old_st.st_ino == new_st.st_ino)) {
+        close(fd);
+        return;
+    }
+
+    drain(f); // whatever the writer added before letting go of the old file
+    unwatch(idx);
+    close(f.fd);
+
+    f.fd = fd;
+    f.rotated = false;
+    watch(idx);
+    drain(f);
+}
+
+int Follower::run() {
+    inotify_fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify_fd_ < 0) {
+        std::cerr << "Error: inotify is not available" << std::endl;
+        return 1;
+    }
+
+    for (size_t idx = 0; idx < files_.size(); ++idx) {
+        FollowedFile &f = files_[idx];
+        watch(idx);
+
+        // the directory tells us when a rotated file shows up again
+        size_t slash = f.path.rfind('/');
+        std::string dir = (slash == std::string::npos) ? "." : (slash == 0 ? "/" : f.path.substr(0, slash));
+        f.dir_wd = inotify_add_watch(inotify_fd_, dir.c_str(), IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+        if (f.dir_wd >= 0) {
+            dir_watches_[f.dir_wd].push_back(idx);
+        }
+    }
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) {
+        std::cerr << "Error: epoll is not available" << std::endl;
+        return 1;
+    }
+
+    // SIGINT/SIGTERM arrive through a signalfd, so buffered output is flushed on the way out;
+    // without one they keep their default action instead of being blocked for good
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    int sig_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    if (sig_fd < 0) {
+        sigprocmask(SIG_UNBLOCK, &mask, nullptr);
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = inotify_fd_;
+    epoll_ctl(ep, EPOLL_CTL_ADD, inotify_fd_, &ev);
+    if (sig_fd >= 0) {
+        ev.data.fd = sig_fd;
+        epoll_ctl(ep, EPOLL_CTL_ADD, sig_fd, &ev);
+    }
+
+    out().flush(); // the first pass is complete
+    alignas(struct inotify_event) char buf[64 * 1024];
+    std::vector<bool> dirty(files_.size());
+
+    while (true) {
+        struct epoll_event events[4];
+        int n = epoll_wait(ep, events, 4, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        bool stop = false;
+        for (int e = 0; e < n; ++e) {
+            if (events[e].data.fd == sig_fd) stop = true;
+        }
+        if (stop) break;
+
+        // collect every pending event first, so a burst of writes costs one drain per file
+        std::fill(dirty.begin(), dirty.end(), false);
+        std::vector<size_t> rotations;
+        bool overflow = false;
+        while (true) {
+            ssize_t len = read(inotify_fd_, buf, sizeof(buf));
+            if (len <= 0) break; // EAGAIN: queue is empty
+
+            for (char *p = buf; p < buf + len; ) {
+                struct inotify_event *ie = reinterpret_cast<struct inotify_event*>(p);
+                p += sizeof(struct inotify_event) + ie->len;
+
+                if (ie->mask & IN_Q_OVERFLOW) {
+                    overflow = true;
+                    continue;
+                }
+
+                auto fw = file_watches_.find(ie->wd);
+                if (fw != file_watches_.end()) {
+                    for (size_t idx : fw->second) {
+                        struct stat st;
+                        if ((ie->mask & (IN_MOVE_SELF | IN_DELETE_SELF)) ||
+                            ((ie->mask & IN_ATTRIB) && fstat(files_[idx].fd, &st) == 0 && st.st_nlink == 0)) {
+                            files_[idx].rotated = true;
+                            rotations.push_back(idx);
+                        }
+                        if (ie->mask & IN_MODIFY) {
+                            dirty[idx] = true;
+                        }
+                    }
+                }
+
+                auto dw = dir_watches_.find(ie->wd);
+                if (dw != dir_watches_.end() && ie->len > 0) {
+                    for (size_t idx : dw->second) {
+                        if (files_[idx].rotated && files_[idx].name == ie->name) {
+                            rotations.push_back(idx);
+                        }
+                    }
+                }
+            }
+        }
+
+        for (size_t idx = 0; idx < files_.size(); ++idx) {
+            if (dirty[idx] || overflow) {
+                drain(files_[idx]);
+            }
+            if (overflow) { // events may be lost: check for a replaced file too
+                files_[idx].rotated = true;
+                rotations.push_back(idx);
+            }
+        }
+        for (size_t idx : rotations) {
+            switch_if_replaced(idx);
+        }
+        out().flush(); // make the new data visible right away
+    }
+
+    close(ep);
+    if (sig_fd >= 0) close(sig_fd);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,45 @@
+#ifndef MYDIR_H
+#define MYDIR_H
+
+// Directory reading on the raw getdents64 syscall, shared by myls and
+// mygrep -r: one syscall fills a buffer with many entries, each carrying its
+// d_type. Header-only like myio.h.
+
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <unistd.h>
+#include <dirent.h> // DT_* types of getdents64 entries
+#include <sys/syscall.h>
+
+// layout of the records getdents64 fills in
+struct Dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+// Call fn(name, d_type) for every entry of the open directory fd except "."
+// and "..", in directory order, reading through buf. d_type may be
+// DT_UNKNOWN; name is only valid during the call. Returns false on a read
+// error (the entries before it have been passed to fn).
+template <typename Fn>
+bool read_dirents(int fd, std::vector<char> &buf, Fn fn) {
+    while (true) {
+        long n = syscall(SYS_getdents64, fd, buf.data(), buf.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) return true;
+        for (long off = 0; off < n;) {
+            const Dirent64 *d = reinterpret_cast<const Dirent64*>(buf.data() + off);
+            off += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+            fn(name, d->d_type);
+        }
+    }
+}
+
+#endif // MYDIR_H
@@ -1,82 +1,492 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <memory>
 #include <string>
 #include <unordered_map>
-#include <algorithm>
-#include <cctype>
 #include <vector>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "myio.h"
+#include "mysearch.h"
+#include "myregex.h"
+#include "myindex.h"
+#include "mydir.h"
+
+// ANSI color codes, emptied in main when color is off
+std::string RED = "\033[31m";
+std::string GREEN = "\033[32m";
+std::string YELLOW = "\033[33m";
+std::string LIGHT_BLUE = "\033[94m";
+std::string PURPLE = "\033[35m";
+
+std::string COLOR_MATCH = RED; // color for matched pattern
+std::string COLOR_RESET = "\033[0m";   // reset color
+
+// Byte range of one match inside a line
+struct Span {
+    size_t begin;
+    size_t len;
+};
+
+// The compiled pattern set. find() reports the leftmost match at or after
+// from (the longest one there); matches never contain '\n'.
+class Matcher {
+public:
+    virtual ~Matcher() = default;
+    virtual bool find(const char *hay, size_t n, size_t from, Span &match) const = 0;
+
+    // Some position in the first line at or after from that has a match (a
+    // byte of it or its '\n'), for when only the line matters. By default
+    // the start of the match find() reports.
+    virtual bool find_line(const char *hay, size_t n, size_t from, size_t &pos) const {
+        Span match;
+        if (!find(hay, n, from, match)) return false;
+        pos = match.begin;
+        return true;
+    }
 
-// ANSI color codes for furture enhancements
-const std::string RED = "\033[31m";
-const std::string GREEN = "\033[32m";
-const std::string YELLOW = "\033[33m";
-const std::string LIGHT_BLUE = "\033[94m";
-const std::string PURPLE = "\033[35m";
+    // A matcher for another thread (find may keep caches of its own)
+    virtual std::unique_ptr<Matcher> clone() const = 0;
 
-const std::string COLOR_MATCH = RED; // color for matched pattern
-const std::string COLOR_RESET = "\033[0m";   // reset color
+    // Strings of which every match contains at least one, for --index to
+    // narrow the files with (empty: every file may match)
+    virtual std::vector<std::string> literals() const = 0;
+};
 
-void process_stream(std::istream &in, const std::string &pattern, 
-                   std::unordered_map<std::string, bool> &options,
-                   const std::string &filename, bool multiple_files);
+// One fixed string: the SIMD/Horspool literal searcher
+class LiteralMatcher : public Matcher {
+public:
+    LiteralMatcher(const std::string &pattern, bool ignore_case)
+        : searcher_(pattern, ignore_case),
+          never_(pattern.empty() || pattern.find('\n') != std::string::npos) {} // lines hold no '\n'
+
+    bool find(const char *hay, size_t n, size_t from, Span &match) const override {
+        if (never_) return false;
+        size_t pos = searcher_.find(hay, n, from);
+        if (pos == LiteralSearcher::npos) return false;
+        match = Span{pos, searcher_.size()};
+        return true;
+    }
+
+    std::unique_ptr<Matcher> clone() const override { return std::unique_ptr<Matcher>(new LiteralMatcher(*this)); }
+
+    std::vector<std::string> literals() const override { return {searcher_.needle()}; }
+
+private:
+    LiteralSearcher searcher_;
+    bool never_;
+};
+
+// Several fixed strings (-e/-f): one Aho-Corasick pass instead of one pass per pattern
+class MultiMatcher : public Matcher {
+public:
+    MultiMatcher(const std::vector<std::string> &patterns, bool ignore_case)
+        : automaton_(patterns, ignore_case), patterns_(patterns) {}
+
+    bool find(const char *hay, size_t n, size_t from, Span &match) const override {
+        return automaton_.find(hay, n, from, match.begin, match.len);
+    }
 
-// Function to colorize matched patterns in a line
-std::string colorize_line(const std::string& line, const std::string& pattern, std::unordered_map<std::string, bool>& options) {
+    std::unique_ptr<Matcher> clone() const override { return std::unique_ptr<Matcher>(new MultiMatcher(*this)); }
 
-    size_t n = pattern.size();
-    if (n == 0) return line; // avoid infinite loop on empty pattern
+    std::vector<std::string> literals() const override { return patterns_; }
+
+private:
+    AhoCorasick automaton_;
+    std::vector<std::string> patterns_;
+};
+
+// -E/-G: the patterns as one regular expression (lazy DFA, literal prefilter)
+class RegexMatcher : public Matcher {
+public:
+    bool compile(const std::vector<std::string> &patterns, bool extended, bool ignore_case, std::string &error) {
+        patterns_ = patterns;
+        extended_ = extended;
+        ignore_case_ = ignore_case;
+        return regex_.compile(patterns, extended, ignore_case, error);
+    }
+
+    bool find(const char *hay, size_t n, size_t from, Span &match) const override {
+        return regex_.find(hay, n, from, match.begin, match.len);
+    }
+
+    // the end of the first match to end: no leftmost-longest span needed
+    bool find_line(const char *hay, size_t n, size_t from, size_t &pos) const override {
+        pos = regex_.first_end(hay, n, from);
+        return pos != Regex::npos;
+    }
+
+    // the DFA caches fill up during find: every thread compiles its own
+    std::unique_ptr<Matcher> clone() const override {
+        std::unique_ptr<RegexMatcher> copy(new RegexMatcher);
+        std::string error;
+        copy->compile(patterns_, extended_, ignore_case_, error); // compiled once already
+        return std::unique_ptr<Matcher>(std::move(copy));
+    }
+
+    std::vector<std::string> literals() const override { return regex_.required_literals(); }
+
+private:
+    Regex regex_;
+    std::vector<std::string> patterns_;
+    bool extended_ = false;
+    bool ignore_case_ = false;
+};
+
+// The flags the search itself reads, resolved once in main from the option
+// map: the threads of -j and -r share them read-only
+struct SearchOptions {
+    bool invert = false;              // -v
+    bool only_matching = false;       // -o
+    bool count = false;               // -c
+    bool number = false;              // -n
+    bool quiet = false;               // -q
+    bool files_with_matches = false;  // -l
+    bool files_without_match = false; // -L
+    bool pipeline = false;            // --pipeline
+    size_t max_count = SIZE_MAX;      // -m NUM: stop reading a file after NUM selected lines
+};
+
+SearchOptions resolve_search_options(std::unordered_map<std::string, bool> &options, size_t max_count);
+bool process_stream(int fd, const Matcher &matcher, const SearchOptions &options,
+                   const std::string &filename, bool multiple_files, OutputWriter &out, unsigned jobs = 1);
+bool search_parallel(const char *data, size_t len, const Matcher &matcher, const SearchOptions &options,
+                     const std::string &filename, bool multiple_files, OutputWriter &out, unsigned jobs);
+size_t count_newlines(const char *p, size_t n);
+class BufferSearch;
+void search_pipelined(int fd, BufferSearch &engine, OutputWriter &out);
+
+// Find the non-overlapping matches in a line, left to right, as offsets into
+// the line itself. Stops after the first one unless all is set. Empty regex
+// matches select the line but have nothing to show, so they are skipped.
+size_t find_matches(const char *line, size_t len, const Matcher& matcher, std::vector<Span>& spans, bool all) {
+    spans.clear();
+    Span match;
+    for (size_t pos = 0; pos <= len && matcher.find(line, len, pos, match);) {
+        if (match.len == 0) {
+            pos = match.begin + 1;
+            continue;
+        }
+        spans.push_back(match);
+        if (!all) break;
+        pos = match.begin + match.len;
+    }
+    return spans.size();
+}
 
+// Write a line with every match span wrapped in the match color
+void colorize_line(OutputWriter &out, const char *line, size_t len, const std::vector<Span>& spans) {
     size_t pos = 0;
-    std::string result;
+    for (const Span &span : spans) {
+        out.write(line + pos, span.begin - pos);
+        out << COLOR_MATCH;
+        out.write(line + span.begin, span.len);
+        out << COLOR_RESET;
+        pos = span.begin + span.len;
+    }
+    out.write(line + pos, len - pos);
+}
 
-    // handle case insensitive search
-    std::string lower_line = line;
-    std::string lower_pattern = pattern;
-    if (options["-i"] == true) {
-        std::transform(lower_line.begin(), lower_line.end(), lower_line.begin(), ::tolower);
-        std::transform(lower_pattern.begin(), lower_pattern.end(), lower_pattern.begin(), ::tolower);
+// Lock-free single-producer/single-consumer queue of pointers for the stages
+// of --pipeline. A ring is sized to hold every buffer that circulates through
+// it, so push never finds it full; pop spins briefly on an empty ring and then
+// sleeps on a futex until the producer wakes it. capacity: a power of two.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(uint32_t capacity) : slots_(capacity) {}
+
+    void push(T *item) {
+        uint32_t t = tail_.load(std::memory_order_relaxed);
+        slots_[t & (slots_.size() - 1)] = item;
+        tail_.store(t + 1);
+        if (sleeping_.load()) futex(FUTEX_WAKE_PRIVATE, 1);
     }
 
-    while (true) {
-        // Find the next match position
-        size_t found = lower_line.find(lower_pattern, pos);
+    T *pop() {
+        for (int spin = 0; tail_.load(std::memory_order_acquire) == head_; ++spin) {
+            if (spin < 128) continue;
+            sleeping_.store(true);
+            if (tail_.load() == head_) futex(FUTEX_WAIT_PRIVATE, head_); // returns at once if it moved
+            sleeping_.store(false);
+        }
+        T *item = slots_[head_ & (slots_.size() - 1)];
+        ++head_;
+        return item;
+    }
 
-        if (found == std::string::npos) {
-            // No more matches, append the remaining part
-            result += line.substr(pos);
-            break;
+    bool empty() const { return tail_.load(std::memory_order_acquire) == head_; } // consumer only
+
+private:
+    void futex(int op, uint32_t value) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&tail_), op, value, nullptr, nullptr, 0);
+    }
+
+    std::vector<T*> slots_;
+    std::atomic<uint32_t> tail_{0}; // pushes so far; the futex word
+    uint32_t head_ = 0;             // pops so far, consumer side
+    std::atomic<bool> sleeping_{false};
+};
+
+// Buffer-oriented search: the pattern is looked for across a whole buffer of
+// lines, and line boundaries are located only around the hits. Line numbers
+// for -n are computed lazily by counting newlines up to each printed line.
+// State survives across search() calls, so a stream can be fed block by block.
+class BufferSearch {
+public:
+    BufferSearch(const Matcher &matcher, const SearchOptions &options,
+                 const std::string &filename, bool multiple_files, OutputWriter &out);
+
+    // buf holds complete lines; only the last one of the input may lack its '\n'
+    void search(const char *buf, size_t len);
+    void finish(); // print the -c count or the -l/-L name
+
+    // -m, -q, -l and -L need no more input once enough lines are selected
+    bool stops_early() const { return limit_ != SIZE_MAX; }
+    bool done() const { return match_count_ >= limit_; }
+
+    // -j: a chunk of a file starts at line first; its -c count goes to the file's
+    void start_at_line(size_t first) { line_number_ = first; }
+    size_t match_count() const { return match_count_; }
+    void add_matches(size_t n) { match_count_ += n; }
+
+    // --pipeline: each block's output goes to a writer of its own
+    void set_output(OutputWriter &out) { out_ = &out; }
+
+private:
+    void matching_line(const char *line, const char *end);
+    void other_lines(const char *begin, const char *end); // lines without a match
+    void print_line(const char *line, size_t len);
+    void advance_to(const char *p);
+
+    const Matcher &matcher_;
+    const std::string &filename_;
+    OutputWriter *out_;
+    bool invert_;
+    bool only_matching_;
+    bool count_only_;
+    bool number_;
+    bool prefix_;
+    bool all_matches_;
+    bool print_lines_;     // off for -c, -q, -l, -L: selected lines are only counted
+    bool quiet_;
+    char list_ = 0;        // 'l' or 'L': print the file name instead
+    size_t limit_;         // selected lines after which the file is done
+
+    size_t line_number_ = 1;         // number of the line starting at counted_
+    const char *counted_ = nullptr;  // newlines before this point are in line_number_
+    size_t match_count_ = 0;         // selected lines so far
+    std::vector<Span> spans_;        // reused for every line
+};
+
+// Call fn(path, is_directory) for every subdirectory and regular file in dir
+// ("" is the current directory, and its entries get no "./" prefix). Entries
+// are read with getdents64 and sorted out by d_type, so no stat is needed;
+// symbolic links are not followed. Returns false if dir cannot be opened.
+template <typename Fn>
+bool read_directory(const std::string &dir, Fn fn) {
+    int fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) return false;
+
+    thread_local std::vector<char> buf(1 << 16);
+    std::string base = dir;
+    if (!base.empty() && base.back() != '/') base += '/';
+
+    read_dirents(fd, buf, [&](const char *name, unsigned char type) {
+        if (type == DT_UNKNOWN) { // some filesystems leave it to stat
+            struct stat st;
+            if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
         }
+        if (type == DT_DIR || type == DT_REG) fn(base + name, type == DT_DIR);
+    });
+    close(fd);
+    return true;
+}
 
-        result += line.substr(pos, found - pos);
-        result += COLOR_MATCH + line.substr(found, n) + COLOR_RESET; // add colored match
+// -r: every regular file under the given paths is searched on a pool of
+// threads. Each thread owns a deque of pending directories and files: it takes
+// its own newest entry (depth first, keeps deques short) and steals the oldest
+// one of another thread when it runs dry. A file's output is collected in
+// memory and written in one piece, so files never interleave.
+class TreeSearch {
+public:
+    TreeSearch(const Matcher &matcher, const SearchOptions &options);
 
-        pos = found + n;
+    // No roots: the current directory, with names printed relative to it.
+    // Returns whether some line was selected.
+    bool run(const std::vector<std::string> &roots);
+
+private:
+    struct Work {
+        std::string path;
+        bool directory;
+    };
+    struct Queue {
+        std::mutex mu;
+        std::deque<Work> items;
+    };
+
+    void worker(size_t self);
+    bool next(size_t self, Work &work);
+    void push(size_t self, Work work);
+    void walk(size_t self, const std::string &dir);
+    void search_file(const std::string &path, const Matcher &matcher, OutputWriter &buffer);
+
+    const Matcher &matcher_;
+    const SearchOptions &options_;
+    bool prefix_ = true;
+    bool quiet_;                     // -q: stop at the first selected line
+    std::atomic<bool> selected_{false};
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::atomic<size_t> pending_{0}; // queued or being worked on
+    std::atomic<size_t> queued_{0};  // waiting in some deque
+    std::atomic<size_t> sleepers_{0};
+    std::mutex idle_mu_;             // threads without work wait on idle_cv_
+    std::condition_variable idle_cv_;
+    std::mutex out_mu_;              // stdout and stderr
+};
+
+// Add the patterns of -e (one per line of the value, like grep) or of the
+// file named by -f (one per line; empty lines are ignored).
+bool add_patterns(const std::string &opt, const std::string &value, std::vector<std::string> &patterns) {
+    std::ifstream file;
+    std::istringstream text;
+    std::istream *in = &text;
+    if (opt == "-f") {
+        file.open(value);
+        if (!file) {
+            std::cerr << "Error: Could not open pattern file " << value << std::endl;
+            return false;
+        }
+        in = &file;
+    } else {
+        text.str(value);
     }
-    return result;
+
+    std::string line;
+    size_t added = 0;
+    while (std::getline(*in, line)) {
+        if (line.empty()) continue;
+        patterns.push_back(line);
+        ++added;
+    }
+    if (opt == "-e" && added == 0) {
+        std::cerr << "Error: Search string cannot be empty." << std::endl;
+        return false;
+    }
+    return true;
 }
 
-// Function to extract all matching substrings from a line
-void extract_matches(const std::string& line, const std::string& pattern, std::unordered_map<std::string, bool>& options, std::vector<std::string>& matches) {
-    size_t n = pattern.size();
-    if (n == 0) return;
+SearchOptions resolve_search_options(std::unordered_map<std::string, bool> &options, size_t max_count) {
+    SearchOptions resolved;
+    resolved.invert = options["-v"];
+    resolved.only_matching = options["-o"];
+    resolved.count = options["-c"];
+    resolved.number = options["-n"];
+    resolved.quiet = options["-q"];
+    resolved.files_with_matches = options["-l"];
+    resolved.files_without_match = options["-L"];
+    resolved.pipeline = options["--pipeline"];
+    resolved.max_count = max_count;
+    return resolved;
+}
 
-    std::string lower_line = line;
-    std::string lower_pattern = pattern;
-    if (options["-i"]) {
-        std::transform(lower_line.begin(), lower_line.end(), lower_line.begin(), ::tolower);
-        std::transform(lower_pattern.begin(), lower_pattern.end(), lower_pattern.begin(), ::tolower);
+// The matcher for the pattern set: the algorithm is picked once, and -i folds
+// case inside the search. Returns null (with error set) for a bad regex.
+std::unique_ptr<Matcher> make_matcher(const std::vector<std::string> &patterns,
+                                      std::unordered_map<std::string, bool> &options, std::string &error) {
+    if (options["-E"] || options["-G"]) {
+        std::unique_ptr<RegexMatcher> regex(new RegexMatcher);
+        if (!regex->compile(patterns, options["-E"], options["-i"], error)) {
+            return nullptr;
+        }
+        return std::unique_ptr<Matcher>(std::move(regex));
+    }
+    if (patterns.size() == 1) {
+        return std::unique_ptr<Matcher>(new LiteralMatcher(patterns[0], options["-i"]));
     }
+    return std::unique_ptr<Matcher>(new MultiMatcher(patterns, options["-i"]));
+}
 
-    size_t pos = 0;
-    while (true) {
-        size_t found = lower_line.find(lower_pattern, pos);
-        if (found == std::string::npos) {
-            break;
+// --build-index: the regular files under the given paths (default: the
+// current directory), sorted, with the names -r would print.
+void collect_files(const std::vector<std::string> &roots, std::vector<std::string> &files) {
+    std::vector<std::string> dirs;
+    if (roots.empty()) dirs.push_back("");
+    for (const std::string &root : roots) {
+        struct stat st;
+        if (stat(root.c_str(), &st) != 0) {
+            std::cerr << "Error: Could not open file " << root << std::endl;
+        } else if (S_ISDIR(st.st_mode)) {
+            dirs.push_back(root);
+        } else if (S_ISREG(st.st_mode)) {
+            files.push_back(root);
         }
+    }
+    while (!dirs.empty()) {
+        std::string dir = std::move(dirs.back());
+        dirs.pop_back();
+        bool ok = read_directory(dir, [&](std::string path, bool directory) {
+            (directory ? dirs : files).push_back(std::move(path));
+        });
+        if (!ok) std::cerr << "Error: Could not open directory " << dir << std::endl;
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+}
+
+// --index: search the files recorded in the index, in index order. Files that
+// cannot hold a match by their trigrams are not read (their -c count is 0 and
+// -L lists them); files changed since the build are always searched.
+bool search_indexed(const TrigramIndex &index, const Matcher &matcher,
+                    const SearchOptions &options, unsigned jobs) {
+    std::vector<std::string> literals = matcher.literals();
+    bool narrow = !options.invert && !literals.empty(); // -v selects lines without the pattern
+    std::vector<bool> candidate = narrow ? index.candidates(literals) : std::vector<bool>(index.files(), true);
 
-        matches.push_back(line.substr(found, n));
-        pos = found + n;
+    bool multiple_files = index.files() > 1;
+    bool selected = false;
+    for (size_t k = 0; k < index.files(); ++k) {
+        std::string filename = index.path(k);
+        struct stat st;
+        if (stat(filename.c_str(), &st) != 0) {
+            std::cerr << "Error: Could not open file " << filename << std::endl;
+            continue;
+        }
+        if (!candidate[k] && index.fresh(k, st)) {
+            BufferSearch search(matcher, options, filename, multiple_files, out());
+            search.finish();
+            continue;
+        }
+
+        int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            std::cerr << "Error: Could not open file " << filename << std::endl;
+            continue;
+        }
+        if (process_stream(fd, matcher, options, filename, multiple_files, out(), jobs)) {
+            selected = true;
+        }
+        close(fd);
+        if (selected && options.quiet) break; // the answer is known
     }
+    return selected;
 }
 
 // Main function
@@ -87,6 +497,14 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // -e/-f patterns; without them the first operand is the pattern
+    std::vector<std::string> patterns;
+    bool pattern_options = false;
+    unsigned jobs = 1; // -j: threads per large file
+    size_t max_count = SIZE_MAX; // -m: selected lines per file
+    std::string index_dir;       // --index: search the files indexed there
+    std::string build_index_dir; // --build-index: index the operands there instead
+
     // Options map for future enhancements
     std::unordered_map<std::string, bool> options{
         {"--help", false}, // Display help information
@@ -94,11 +512,22 @@ int main(int argc, char *argv[]) {
         {"-i", false}, // Case insensitive search
         {"-v", false}, // Invert match
         {"-o", false}, // Only matching parts of lines
-        {"-c", false} // Count of matching lines
+        {"-c", false}, // Count of matching lines
+        {"-E", false}, // Extended regular expressions
+        {"-G", false}, // Basic regular expressions
+        {"-F", false}, // Fixed strings (the default)
+        {"-r", false}, // Search directories recursively
+        {"-q", false}, // Quiet: exit status only
+        {"-l", false}, // Names of files with a selected line
+        {"-L", false}, // Names of files without one
+        {"--pipeline", false} // Read, search and write streams on separate threads
     };
 
+    ColorMode color_mode = ColorMode::Auto;
+
     // process options
     size_t i = 1;
+    const size_t arg_count = static_cast<size_t>(argc); // for comparisons with i
     for (i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         
@@ -112,46 +541,174 @@ int main(int argc, char *argv[]) {
                           << "  -i        Case insensitive search\n"
                           << "  -v        Invert match\n"
                           << "  -o        Only matching parts of lines\n"
-                          << "  -c        Count of matching lines\n";
+                          << "  -c        Count of matching lines\n"
+                          << "  -E        Patterns are extended regular expressions\n"
+                          << "  -G        Patterns are basic regular expressions\n"
+                          << "  -F        Patterns are fixed strings (default)\n"
+                          << "  -r        Search every file under the given directories (default: .)\n"
+                          << "  -q        Print nothing; exit with 0 at the first selected line\n"
+                          << "  -l        Print only the names of files with a selected line\n"
+                          << "  -L        Print only the names of files without one\n"
+                          << "  -m NUM    Stop reading a file after NUM selected lines\n"
+                          << "  -e PATTERN  Search for PATTERN (repeatable)\n"
+                          << "  -f FILE   Read patterns from FILE, one per line\n"
+                          << "  -j N      Search each large file with N threads\n"
+                          << "  --color=WHEN  Colorize output: auto (default), always, never\n"
+                          << "  --pipeline    Read, search and write standard input and pipes on separate threads\n"
+                          << "  --build-index=DIR  Index the files under the operands (default: .) in DIR\n"
+                          << "  --index=DIR   Search the files indexed in DIR, skipping those that cannot match\n";
                 return 0;
+            } else if (arg.compare(0, 13, "--build-index") == 0 || arg.compare(0, 7, "--index") == 0) {
+                // takes a value: --index=DIR or --index DIR
+                std::string name = arg.substr(0, arg.find('='));
+                if (name != "--build-index" && name != "--index") {
+                    std::cerr << "Warning: Unknown option " << arg << std::endl;
+                    return 1;
+                }
+                std::string value;
+                if (name.size() < arg.size()) {
+                    value = arg.substr(name.size() + 1);
+                } else if (i + 1 < arg_count) {
+                    value = argv[++i];
+                }
+                if (value.empty()) {
+                    std::cerr << "Error: Option " << name << " requires a directory" << std::endl;
+                    return 1;
+                }
+                (name == "--index" ? index_dir : build_index_dir) = value;
+            } else if (arg == "--pipeline") {
+                options[arg] = true;
+            } else if (arg.compare(0, 7, "--color") == 0) {
+                if (!parse_color_option(arg, color_mode)) {
+                    std::cerr << "Error: Invalid argument for --color: " << arg << std::endl;
+                    return 1;
+                }
             } else {
 
                 // support merging of single-character options like -ni
                 for (size_t j = 1; j < arg.size(); ++j) {
                     std::string opt("-" + std::string(1, arg[j]));
 
-                    if (options.find(opt) != options.end()) {
+                    if (opt == "-m") { // takes a value: -m5 or -m 5
+                        std::string value = arg.substr(j + 1);
+                        if (value.empty() && i + 1 < arg_count) {
+                            value = argv[++i];
+                        }
+                        char *end = nullptr;
+                        unsigned long long n = std::strtoull(value.c_str(), &end, 10);
+                        if (value.empty() || *end != '\0' || value[0] == '-') {
+                            std::cerr << "Error: Invalid max count for -m: " << value << std::endl;
+                            return 1;
+                        }
+                        max_count = static_cast<size_t>(n);
+                        break;
+                    } else if (opt == "-j") { // takes a value: -j4 or -j 4
+                        std::string value = arg.substr(j + 1);
+                        if (value.empty() && i + 1 < arg_count) {
+                            value = argv[++i];
+                        }
+                        char *end = nullptr;
+                        long n = std::strtol(value.c_str(), &end, 10);
+                        if (value.empty() || *end != '\0' || n < 1 || n > 1024) {
+                            std::cerr << "Error: Invalid thread count for -j: " << value << std::endl;
+                            return 1;
+                        }
+                        jobs = static_cast<unsigned>(n);
+                        break;
+                    } else if (opt == "-e" || opt == "-f") { // take a value: -efoo or -e foo
+                        std::string value = arg.substr(j + 1);
+                        if (j + 1 == arg.size()) {
+                            if (i + 1 >= arg_count) {
+                                std::cerr << "Error: Option " << opt << " requires an argument" << std::endl;
+                                return 1;
+                            }
+                            value = argv[++i];
+                        }
+                        if (!add_patterns(opt, value, patterns)) {
+                            return 1;
+                        }
+                        pattern_options = true;
+                        break;
+                    } else if (options.find(opt) != options.end()) {
                         options[opt] = true; // Enable the option
                     } else {
                         std::cerr << "Warning: Unknown option " << opt << std::endl;
                         return 1;
                     }
                 }
-
-                // Handle special case where -v and -o are both set without a search string
-                if (options["-v"] == true && options["-o"] == true) {
-                    return 0;
-                }
             }
         } else { // string to grep
             break; // Stop processing options when the search string is encountered
         }
     }
 
+    // --build-index takes no pattern: the operands are the paths to index
+    if (!build_index_dir.empty()) {
+        std::vector<std::string> files;
+        collect_files(std::vector<std::string>(argv + i, argv + argc), files);
+        TrigramIndex::BuildStats stats;
+        std::string error;
+        if (!TrigramIndex::build(build_index_dir, files, stats, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Indexed " << stats.files << " files (" << stats.scanned << " read), "
+                  << stats.trigrams << " trigrams in " << TrigramIndex::file_in(build_index_dir) << std::endl;
+        return 0;
+    }
+
+    // Handle special case where -v and -o are both set without a search string
+    if (options["-v"] == true && options["-o"] == true) {
+        return 0;
+    }
+
+    apply_color_mode(color_mode, {&RED, &GREEN, &YELLOW, &LIGHT_BLUE, &PURPLE, &COLOR_MATCH, &COLOR_RESET});
+
     // Get the text information to be filtered
-    std::string str = argv[i];
-    if (str.empty()) {
-        std::cerr << "Error: Search string cannot be empty." << std::endl;
+    if (!pattern_options) {
+        if (i >= arg_count) {
+            std::cerr << "Usage: " << argv[0] << " [options] <pattern> <filename...>" << std::endl;
+            return 1;
+        }
+        std::string str = argv[i];
+        if (str.empty()) {
+            std::cerr << "Error: Search string cannot be empty." << std::endl;
+            return 1;
+        }
+        patterns.push_back(str);
+        ++i; // point to the first file
+    }
+
+    std::string error;
+    std::unique_ptr<Matcher> matcher = make_matcher(patterns, options, error);
+    const SearchOptions search_options = resolve_search_options(options, max_count);
+    if (!matcher) {
+        std::cerr << "Error: " << error << std::endl;
         return 1;
     }
-    ++i; // point to the first file
 
-    std::string lower_str = str;
-    if (options["-i"] == true) {
-        // Convert search string to lowercase for case insensitive search
-        std::transform(lower_str.begin(), lower_str.end(), lower_str.begin(), ::tolower);
+    // exit status like grep: 0 when some line was selected, 1 otherwise
+    if (!index_dir.empty()) {
+        if (i < arg_count) {
+            std::cerr << "Error: --index searches the indexed files; no file operands allowed" << std::endl;
+            return 1;
+        }
+        TrigramIndex index;
+        if (!index.open(index_dir, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        return search_indexed(index, *matcher, search_options, jobs) ? 0 : 1;
+    }
+
+    if (options["-r"]) {
+        std::vector<std::string> roots(argv + i, argv + argc);
+        TreeSearch tree(*matcher, search_options);
+        return tree.run(roots) ? 0 : 1;
     }
 
+    bool selected = false;
+
     // process files or standard input
     if (i < argc) {
         // check if multiple files are provided
@@ -160,88 +717,599 @@ int main(int argc, char *argv[]) {
         for (; i < argc; ++i) {
             std::string filename = argv[i];
 
-            std::ifstream infile(filename);
-            if (!infile) {
+            int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) {
                 std::cerr << "Error: Could not open file " << filename << std::endl;
                 continue;
             }
-            process_stream(infile, str, options, filename, multiple_files);
+            if (process_stream(fd, *matcher, search_options, filename, multiple_files, out(), jobs)) {
+                selected = true;
+            }
 
-            infile.close();
+            close(fd);
+            if (selected && search_options.quiet) break; // the answer is known
         }
     } else { // read from standard input
-        process_stream(std::cin, str, options, "", false);
+        selected = process_stream(STDIN_FILENO, *matcher, search_options, "", false, out());
     }
 
-    return 0;
+    return selected ? 0 : 1;
 }
 
-// Function to process an input stream (file or stdin)
-void process_stream(std::istream &in, const std::string &pattern, 
-                   std::unordered_map<std::string, bool> &options,
-                   const std::string &filename, bool multiple_files) {
+// Function to process an input stream (file or stdin). Regular files are
+// mapped and searched as one buffer; pipes and stdin are read in large blocks
+// cut after their last newline.
+bool process_stream(int fd, const Matcher &matcher, const SearchOptions &options,
+                   const std::string &filename, bool multiple_files, OutputWriter &out, unsigned jobs) {
+    const size_t MIN_CHUNK = 4 << 20; // smaller files are not worth a thread
 
-    size_t line_number = 1; // line counter
-    size_t match_count = 0; // match counter
-    std::string lower_pattern = pattern;
+    BufferSearch engine(matcher, options, filename, multiple_files, out);
 
-    // prepare lowercase pattern for case insensitive search
-    if (options["-i"]) {
-        std::transform(lower_pattern.begin(), lower_pattern.end(), 
-                      lower_pattern.begin(), ::tolower);
+    struct stat st;
+    bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    if (regular && st.st_size > 0) {
+        size_t len = static_cast<size_t>(st.st_size);
+        void *data = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, len, MADV_SEQUENTIAL);
+            bool selected;
+            if (jobs > 1 && len >= 2 * MIN_CHUNK && !engine.stops_early()) {
+                selected = search_parallel(static_cast<const char*>(data), len, matcher, options, filename,
+                                           multiple_files, out, jobs);
+            } else {
+                engine.search(static_cast<const char*>(data), len);
+                engine.finish();
+                selected = engine.match_count() > 0;
+            }
+            munmap(data, len);
+            return selected;
+        }
     }
 
-    std::string line;
-    while (std::getline(in, line)) {
-        std::string lower_line = line;
-        if (options["-i"]) {
-            std::transform(lower_line.begin(), lower_line.end(), 
-                          lower_line.begin(), ::tolower);
+    if (options.pipeline) {
+        search_pipelined(fd, engine, out);
+        engine.finish();
+        return engine.match_count() > 0;
+    }
+
+    std::vector<char> buf(1 << 20);
+    size_t fill = 0;
+    while (!engine.done()) {
+        if (fill == buf.size()) {
+            buf.resize(buf.size() * 2); // a line longer than the buffer
         }
+        if (!regular) out.flush(); // matches so far must not wait for a slow producer
+        ssize_t n = read(fd, buf.data() + fill, buf.size() - fill);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
 
-        // Determine if the current line matches the pattern
-        bool is_match = (lower_line.find(lower_pattern) != std::string::npos);
-        if (options["-v"]) { // invert match
-            is_match = !is_match;
+        const void *nl = memrchr(buf.data() + fill, '\n', static_cast<size_t>(n));
+        fill += static_cast<size_t>(n);
+        if (nl == nullptr) continue; // no complete line yet
+
+        size_t complete = static_cast<size_t>(static_cast<const char*>(nl) - buf.data()) + 1;
+        engine.search(buf.data(), complete);
+        std::memmove(buf.data(), buf.data() + complete, fill - complete);
+        fill -= complete;
+    }
+    if (fill > 0 && !engine.done()) {
+        engine.search(buf.data(), fill); // unterminated last line
+    }
+    engine.finish();
+    return engine.match_count() > 0;
+}
+
+// Wait until fd can be read (data, end of file or an error), checking stop
+// every 100 ms so a blocked producer never holds up the end of the search.
+bool wait_readable(int fd, const std::atomic<bool> &stop) {
+    struct pollfd p = {fd, POLLIN, 0};
+    while (!stop.load(std::memory_order_relaxed)) {
+        int r = poll(&p, 1, 100);
+        if (r < 0 && errno == EINTR) continue;
+        if (r != 0) return true;
+    }
+    return false;
+}
+
+// --pipeline: search a stream with three stages, so a slow producer or
+// consumer does not stall the matcher. A reader thread fills blocks with
+// complete lines, this thread searches them into output writers, and a writer
+// thread copies those to out, flushing whenever it catches up. The stages
+// pass fixed sets of blocks and writers around in rings, so the steady state
+// allocates nothing; a null pointer marks the end of the input.
+//
+// Lines are formatted by the matcher, not the writer: BufferSearch prints a
+// line while it still has its match spans and line number at hand. A
+// formatting writer would need those handed over as records and the input
+// block kept alive until it is printed. The writer only does the write(2)
+// calls, which is the stage that blocks on a slow consumer.
+void search_pipelined(int fd, BufferSearch &engine, OutputWriter &out) {
+    const uint32_t BLOCKS = 4;  // input blocks in flight
+    const uint32_t OUTPUTS = 4; // output writers in flight
+    struct Block {
+        std::vector<char> data;
+        size_t len = 0;
+    };
+
+    std::vector<Block> blocks(BLOCKS);
+    std::vector<std::unique_ptr<OutputWriter>> outputs;
+    SpscRing<Block> free_blocks(8), full_blocks(8);         // reader <-> matcher
+    SpscRing<OutputWriter> free_outputs(8), ready_outputs(8); // matcher <-> writer
+    for (Block &b : blocks) {
+        b.data.resize(1 << 20);
+        free_blocks.push(&b);
+    }
+    for (uint32_t k = 0; k < OUTPUTS; ++k) {
+        outputs.emplace_back(new OutputWriter(-1, 1 << 16));
+        free_outputs.push(outputs.back().get());
+    }
+    std::atomic<bool> stop{false}; // the matcher needs no more input
+
+    std::thread reader([&] {
+        Block *cur = free_blocks.pop();
+        size_t fill = 0;
+        while (wait_readable(fd, stop)) {
+            if (fill == cur->data.size()) {
+                cur->data.resize(cur->data.size() * 2); // a line longer than the block
+            }
+            ssize_t n = read(fd, cur->data.data() + fill, cur->data.size() - fill);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+
+            const void *nl = memrchr(cur->data.data() + fill, '\n', static_cast<size_t>(n));
+            fill += static_cast<size_t>(n);
+            if (nl == nullptr) continue; // no complete line yet
+
+            // hand over the complete lines, start the next block with the rest
+            size_t complete = static_cast<size_t>(static_cast<const char*>(nl) - cur->data.data()) + 1;
+            Block *next = free_blocks.pop();
+            if (next->data.size() < cur->data.size()) next->data.resize(cur->data.size());
+            std::memcpy(next->data.data(), cur->data.data() + complete, fill - complete);
+            cur->len = complete;
+            full_blocks.push(cur);
+            cur = next;
+            fill -= complete;
         }
+        cur->len = fill; // unterminated last line, if any
+        full_blocks.push(cur);
+        full_blocks.push(nullptr);
+    });
 
-        if (is_match == true) {
-            if (!options["-c"] || options["-o"]) { // if not counting or only matching parts
-                if (multiple_files && !filename.empty()) {
-                    std::cout << PURPLE << filename << COLOR_RESET 
-                              << LIGHT_BLUE << ":" << COLOR_RESET;
-                }
+    std::thread writer([&] {
+        while (OutputWriter *o = ready_outputs.pop()) {
+            out.write(o->data(), o->pending());
+            o->clear();
+            free_outputs.push(o);
+            if (ready_outputs.empty()) out.flush();
+        }
+    });
 
-                if (options["-o"]) {
-                    std::vector<std::string> matches;
-                    extract_matches(line, pattern, options, matches);
-                    for (const auto &match : matches) {
-                        if (options["-n"]) {
-                            std::cout << GREEN << line_number << COLOR_RESET
-                                      << LIGHT_BLUE << ": \t" << COLOR_RESET;
-                        }
-                        std::cout << COLOR_MATCH << match << COLOR_RESET << std::endl;
-                    }
-                } else {
-                    if (options["-n"]) {
-                        std::cout << GREEN << line_number << COLOR_RESET
-                                  << LIGHT_BLUE << ": \t" << COLOR_RESET;
-                    }
-                    std::cout << colorize_line(line, pattern, options) << std::endl;
+    OutputWriter *w = free_outputs.pop();
+    while (Block *b = full_blocks.pop()) {
+        if (b->len > 0 && !engine.done()) {
+            engine.set_output(*w);
+            engine.search(b->data.data(), b->len);
+            if (w->pending() > 0) {
+                ready_outputs.push(w);
+                w = free_outputs.pop();
+            }
+            if (engine.done()) stop.store(true, std::memory_order_relaxed);
+        }
+        free_blocks.push(b); // after stop, blocks still in flight are only recycled
+    }
+    ready_outputs.push(nullptr);
+    writer.join();
+    reader.join();
+    engine.set_output(out);
+}
+
+// -j: search one mapped file with several threads. The file is cut into
+// chunks at newlines; threads claim them in order and collect their output in
+// memory, and the calling thread writes the chunks strictly in file order, so
+// the output is the same as a serial search. Only a window of chunks is in
+// flight at a time. For -n a chunk first counts its own newlines, then waits
+// for the chunks before it to do the same to learn its first line number.
+bool search_parallel(const char *data, size_t len, const Matcher &matcher, const SearchOptions &options,
+                     const std::string &filename, bool multiple_files, OutputWriter &out, unsigned jobs) {
+    const size_t CHUNK = 4 << 20;
+
+    std::vector<size_t> bounds(1, 0); // chunk k is [bounds[k], bounds[k + 1])
+    while (bounds.back() < len) {
+        size_t end = bounds.back() + CHUNK;
+        if (end >= len) {
+            end = len;
+        } else { // a chunk ends after the newline that ends its last line
+            const void *nl = std::memchr(data + end - 1, '\n', len - end + 1);
+            end = (nl == nullptr) ? len : static_cast<size_t>(static_cast<const char*>(nl) - data) + 1;
+        }
+        bounds.push_back(end);
+    }
+
+    struct Chunk {
+        std::unique_ptr<OutputWriter> output;
+        size_t newlines = 0;
+        size_t matches = 0;
+        bool counted = false;
+        bool done = false;
+    };
+    const size_t count = bounds.size() - 1;
+    const size_t window = 4 * static_cast<size_t>(jobs);
+    const bool number = options.number;
+    std::vector<Chunk> chunks(count);
+    std::vector<size_t> lines_before(count + 1, 0);
+    size_t next_chunk = 0; // the ones below are claimed
+    size_t numbered = 0;   // lines_before is known up to this chunk
+    size_t written = 0;    // the ones below are written
+    std::mutex mu;
+    std::condition_variable cv;
+
+    auto worker = [&]() {
+        std::unique_ptr<Matcher> own = matcher.clone();
+        while (true) {
+            size_t k;
+            {
+                std::unique_lock<std::mutex> lock(mu);
+                cv.wait(lock, [&] { return next_chunk == count || next_chunk < written + window; });
+                if (next_chunk == count) return;
+                k = next_chunk++;
+            }
+            Chunk &chunk = chunks[k];
+            const char *begin = data + bounds[k];
+            size_t size = bounds[k + 1] - bounds[k];
+
+            size_t first_line = 1;
+            if (number) {
+                size_t newlines = count_newlines(begin, size);
+                std::unique_lock<std::mutex> lock(mu);
+                chunk.newlines = newlines;
+                chunk.counted = true;
+                while (numbered < count && chunks[numbered].counted) {
+                    lines_before[numbered + 1] = lines_before[numbered] + chunks[numbered].newlines;
+                    ++numbered;
                 }
-            } else {
-                match_count++;
+                cv.notify_all();
+                cv.wait(lock, [&] { return numbered >= k; });
+                first_line = lines_before[k] + 1;
+            }
+
+            chunk.output.reset(new OutputWriter(-1));
+            BufferSearch engine(*own, options, filename, multiple_files, *chunk.output);
+            engine.start_at_line(first_line);
+            engine.search(begin, size);
+            {
+                std::lock_guard<std::mutex> lock(mu);
+                chunk.matches = engine.match_count();
+                chunk.done = true;
+            }
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < std::min<size_t>(jobs, count); ++t) {
+        threads.emplace_back(worker);
+    }
+
+    BufferSearch total(matcher, options, filename, multiple_files, out); // prints the -c count
+    for (size_t k = 0; k < count; ++k) {
+        {
+            std::unique_lock<std::mutex> lock(mu);
+            cv.wait(lock, [&] { return chunks[k].done; });
+        }
+        Chunk &chunk = chunks[k];
+        out.write(chunk.output->data(), chunk.output->pending());
+        total.add_matches(chunk.matches);
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            chunk.output.reset();
+            written = k + 1;
+        }
+        cv.notify_all();
+    }
+    for (auto &t : threads) t.join();
+    total.finish();
+    return total.match_count() > 0;
+}
+
+BufferSearch::BufferSearch(const Matcher &matcher, const SearchOptions &options,
+                           const std::string &filename, bool multiple_files, OutputWriter &out)
+    : matcher_(matcher), filename_(filename), out_(&out) {
+    invert_ = options.invert;
+    only_matching_ = options.only_matching;
+    count_only_ = options.count && !only_matching_;
+    number_ = options.number;
+    prefix_ = multiple_files && !filename.empty();
+
+    quiet_ = options.quiet;
+    if (options.files_with_matches) {
+        list_ = 'l';
+    } else if (options.files_without_match) {
+        list_ = 'L';
+    }
+    print_lines_ = !count_only_ && !quiet_ && list_ == 0;
+    limit_ = options.max_count;
+    if (quiet_ || list_ != 0) {
+        limit_ = std::min<size_t>(limit_, 1); // the first selected line decides
+    }
+
+    // -o and coloring need every match of a line; a plain filter stops at the
+    // first one (and -v only prints lines without any)
+    all_matches_ = (only_matching_ || !COLOR_MATCH.empty()) && !invert_;
+}
+
+void BufferSearch::search(const char *buf, size_t len) {
+    const char *end = buf + len;
+    const char *p = buf; // first line not handled yet
+    counted_ = buf;
+
+    while (p < end && !done()) {
+        size_t hit;
+        if (!matcher_.find_line(p, static_cast<size_t>(end - p), 0, hit)) {
+            if (invert_) other_lines(p, end);
+            break;
+        }
+
+        // widen the hit to its line
+        const char *h = p + hit;
+        const char *line = static_cast<const char*>(memrchr(p, '\n', static_cast<size_t>(h - p)));
+        line = (line == nullptr) ? p : line + 1;
+        const char *line_end = static_cast<const char*>(std::memchr(h, '\n', static_cast<size_t>(end - h)));
+        if (line_end == nullptr) line_end = end;
+
+        if (invert_) {
+            other_lines(p, line);
+        } else {
+            matching_line(line, line_end);
+        }
+        p = (line_end == end) ? end : line_end + 1;
+    }
+
+    if (number_) advance_to(end); // keep the count for the next block
+}
+
+void BufferSearch::matching_line(const char *line, const char *end) {
+    match_count_++;
+    if (!print_lines_) return;
+
+    size_t len = static_cast<size_t>(end - line);
+    if (all_matches_) {
+        find_matches(line, len, matcher_, spans_, true);
+    } else {
+        spans_.clear(); // printed as-is
+    }
+    print_line(line, len);
+}
+
+// Every line in [begin, end) is selected for -v: printed or just counted
+void BufferSearch::other_lines(const char *begin, const char *end) {
+    if (begin == end) return;
+
+    bool bulk = !print_lines_ || (!number_ && !prefix_);
+    if (bulk && limit_ == SIZE_MAX) { // no line needs handling on its own
+        size_t lines = count_newlines(begin, static_cast<size_t>(end - begin)) + (end[-1] != '\n');
+        match_count_ += lines;
+        if (print_lines_) { // verbatim, in one piece
+            out_->write(begin, static_cast<size_t>(end - begin));
+            if (end[-1] != '\n') *out_ << '\n';
+        }
+        return;
+    }
+
+    spans_.clear();
+    for (const char *line = begin; line < end && !done();) {
+        const char *nl = static_cast<const char*>(std::memchr(line, '\n', static_cast<size_t>(end - line)));
+        const char *line_end = (nl == nullptr) ? end : nl;
+        match_count_++;
+        if (print_lines_) print_line(line, static_cast<size_t>(line_end - line));
+        line = (nl == nullptr) ? end : nl + 1;
+    }
+}
+
+void BufferSearch::print_line(const char *line, size_t len) {
+    if (only_matching_ && spans_.empty()) return; // selected by an empty match: nothing to show
+    if (prefix_) {
+        *out_ << PURPLE << filename_ << COLOR_RESET
+             << LIGHT_BLUE << ":" << COLOR_RESET;
+    }
+    if (number_) {
+        advance_to(line);
+    }
+
+    if (only_matching_) {
+        for (const Span &span : spans_) {
+            if (number_) {
+                *out_ << GREEN << line_number_ << COLOR_RESET
+                     << LIGHT_BLUE << ": \t" << COLOR_RESET;
             }
+            *out_ << COLOR_MATCH;
+            out_->write(line + span.begin, span.len);
+            *out_ << COLOR_RESET << '\n';
         }
-        line_number++;
+    } else {
+        if (number_) {
+            *out_ << GREEN << line_number_ << COLOR_RESET
+                 << LIGHT_BLUE << ": \t" << COLOR_RESET;
+        }
+        colorize_line(*out_, line, len, spans_);
+        *out_ << '\n';
     }
+}
 
-    // print count if -c is specified and -o is not
-    if (options["-c"] && !options["-o"]) {
-        if (multiple_files && !filename.empty()) {
-            std::cout << PURPLE << filename << COLOR_RESET
-                      << LIGHT_BLUE << ":" << COLOR_RESET;
+// Bring line_number_ up to the line that starts at p
+void BufferSearch::advance_to(const char *p) {
+    line_number_ += count_newlines(counted_, static_cast<size_t>(p - counted_));
+    counted_ = p;
+}
+
+// -l/-L print the file name, -c (without -o) the count; -q prints nothing
+void BufferSearch::finish() {
+    if (quiet_) return;
+    if (list_ != 0) {
+        if ((match_count_ > 0) == (list_ == 'l')) {
+            *out_ << PURPLE << (filename_.empty() ? "(standard input)" : filename_.c_str()) << COLOR_RESET << '\n';
+        }
+        return;
+    }
+    if (count_only_) {
+        if (prefix_) {
+            *out_ << PURPLE << filename_ << COLOR_RESET
+                 << LIGHT_BLUE << ":" << COLOR_RESET;
+        }
+        *out_ << match_count_ << '\n';
+    }
+}
+
+// Number of '\n' bytes in [p, p + n)
+size_t count_newlines(const char *p, size_t n) {
+    size_t count = 0;
+    size_t k = 0;
+#if MY_X86
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i zero = _mm_setzero_si128();
+    while (n - k >= 16) {
+        // byte lanes count up to 255 hits before they are summed
+        size_t stop = k + std::min<size_t>((n - k) / 16, 255) * 16;
+        __m128i acc = zero;
+        for (; k < stop; k += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, newline));
         }
-        std::cout << match_count << std::endl;
+        __m128i sums = _mm_sad_epu8(acc, zero);
+        count += static_cast<size_t>(_mm_cvtsi128_si32(sums)) + static_cast<size_t>(_mm_extract_epi16(sums, 4));
+    }
+#endif
+    for (; k < n; ++k) {
+        count += p[k] == '\n';
+    }
+    return count;
+}
+
+TreeSearch::TreeSearch(const Matcher &matcher, const SearchOptions &options)
+    : matcher_(matcher), options_(options) {
+    quiet_ = options.quiet;
+    // walking and searching wait on I/O a lot: a few more threads than cores help
+    unsigned hw = std::thread::hardware_concurrency();
+    size_t threads = std::min(16u, std::max(4u, hw));
+    for (size_t t = 0; t < threads; ++t) {
+        queues_.emplace_back(new Queue);
+    }
+}
+
+bool TreeSearch::run(const std::vector<std::string> &roots) {
+    if (roots.empty()) {
+        push(0, Work{"", true});
+    }
+    // names are printed unless a single file is searched, as without -r
+    prefix_ = roots.size() != 1;
+    for (const std::string &root : roots) {
+        struct stat st;
+        bool directory = stat(root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+        if (directory) prefix_ = true;
+        push(0, Work{root, directory});
+    }
+
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < queues_.size(); ++t) {
+        pool.emplace_back(&TreeSearch::worker, this, t);
+    }
+    for (auto &t : pool) t.join();
+    return selected_;
+}
+
+void TreeSearch::worker(size_t self) {
+    std::unique_ptr<Matcher> matcher = matcher_.clone();
+    OutputWriter buffer(-1);
+
+    Work work;
+    while (true) {
+        if (!next(self, work)) {
+            // wait until another thread queues something or all work is done
+            std::unique_lock<std::mutex> lock(idle_mu_);
+            ++sleepers_;
+            idle_cv_.wait(lock, [this] { return pending_ == 0 || queued_ > 0; });
+            --sleepers_;
+            if (pending_ == 0) return;
+            continue;
+        }
+        if (quiet_ && selected_) {
+            // the answer is known: drain the queues
+        } else if (work.directory) {
+            walk(self, work.path);
+        } else {
+            search_file(work.path, *matcher, buffer);
+        }
+        if (pending_.fetch_sub(1) == 1) { // that was the last one
+            std::lock_guard<std::mutex> lock(idle_mu_);
+            idle_cv_.notify_all();
+        }
+    }
+}
+
+// Own newest entry, else the oldest entry of the first other thread that has one
+bool TreeSearch::next(size_t self, Work &work) {
+    {
+        Queue &own = *queues_[self];
+        std::lock_guard<std::mutex> lock(own.mu);
+        if (!own.items.empty()) {
+            work = std::move(own.items.back());
+            own.items.pop_back();
+            --queued_;
+            return true;
+        }
+    }
+    for (size_t k = 1; k < queues_.size(); ++k) {
+        Queue &victim = *queues_[(self + k) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mu);
+        if (!victim.items.empty()) {
+            work = std::move(victim.items.front());
+            victim.items.pop_front();
+            --queued_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TreeSearch::push(size_t self, Work work) {
+    ++pending_;
+    {
+        Queue &own = *queues_[self];
+        std::lock_guard<std::mutex> lock(own.mu);
+        own.items.push_back(std::move(work));
+    }
+    ++queued_;
+    if (sleepers_ > 0) { // sleepers count themselves before they check queued_
+        std::lock_guard<std::mutex> lock(idle_mu_);
+        idle_cv_.notify_one();
+    }
+}
+
+// Queue the entries of one directory
+void TreeSearch::walk(size_t self, const std::string &dir) {
+    bool ok = read_directory(dir, [&](std::string path, bool directory) {
+        push(self, Work{std::move(path), directory});
+    });
+    if (!ok) {
+        std::lock_guard<std::mutex> lock(out_mu_);
+        std::cerr << "Error: Could not open directory " << dir << std::endl;
+    }
+}
+
+void TreeSearch::search_file(const std::string &path, const Matcher &matcher, OutputWriter &buffer) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        std::lock_guard<std::mutex> lock(out_mu_);
+        std::cerr << "Error: Could not open file " << path << std::endl;
+        return;
+    }
+    if (process_stream(fd, matcher, options_, path, prefix_, buffer)) {
+        selected_ = true;
+    }
+    close(fd);
+
+    if (buffer.pending() > 0) {
+        std::lock_guard<std::mutex> lock(out_mu_);
+        out().write(buffer.data(), buffer.pending());
+        buffer.clear();
     }
 }
@@ -0,0 +1,435 @@
+#ifndef MYINDEX_H
+#define MYINDEX_H
+
+// On-disk trigram index for mygrep --index: for every indexed file, the set
+// of 3-byte sequences its lines contain (ASCII case folded, none spanning a
+// '\n'). A literal can only occur in a file that holds all of its trigrams,
+// so most files of a large corpus are ruled out without being read.
+//
+// The index is one file, DIR/trigrams.idx, memory-mapped at query time:
+//
+//   Header
+//   FileEntry[files]        size and mtime as indexed, path location
+//   path bytes
+//   TrigramEntry[trigrams]  sorted by trigram
+//   postings                per trigram, the ids of the files holding it,
+//                           ascending, as LEB128 varint deltas
+//
+// Rebuilding reuses the trigrams of files whose size and mtime did not
+// change, so only new and modified files are read again.
+// Header-only like myio.h.
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mysearch.h"
+
+class TrigramIndex {
+public:
+    struct BuildStats {
+        size_t files = 0;
+        size_t scanned = 0; // new or changed since the last build
+        size_t trigrams = 0;
+    };
+
+    TrigramIndex() = default;
+    ~TrigramIndex() { close(); }
+
+    TrigramIndex(const TrigramIndex&) = delete;
+    TrigramIndex& operator=(const TrigramIndex&) = delete;
+
+    static std::string file_in(const std::string &dir) { return dir + "/trigrams.idx"; }
+
+    // Map DIR/trigrams.idx. On failure returns false and describes the problem in error.
+    bool open(const std::string &dir, std::string &error);
+    void close();
+
+    size_t files() const { return header_ == nullptr ? 0 : static_cast<size_t>(header_->files); }
+    std::string path(size_t k) const;
+
+    // Whether the file is still as indexed (same size and mtime)
+    bool fresh(size_t k, const struct stat &st) const;
+
+    // Files that may contain one of the literals: those holding every trigram
+    // of at least one literal. A literal shorter than 3 bytes selects all files.
+    std::vector<bool> candidates(const std::vector<std::string> &literals) const;
+
+    // Create or update the index in dir for the given regular files. Files
+    // unchanged since the previous build keep their trigrams without being read.
+    static bool build(const std::string &dir, const std::vector<std::string> &paths, BuildStats &stats,
+                      std::string &error);
+
+private:
+    struct Header {
+        char magic[8];
+        uint64_t files;
+        uint64_t trigrams;
+        uint64_t files_offset;
+        uint64_t paths_offset;
+        uint64_t trigrams_offset;
+        uint64_t postings_offset;
+        uint64_t size; // of the whole index file
+    };
+    struct FileEntry {
+        uint64_t size;
+        int64_t mtime_sec;
+        int64_t mtime_nsec;
+        uint64_t path_offset; // into the path bytes
+        uint64_t path_len;
+    };
+    struct TrigramEntry {
+        uint32_t trigram;
+        uint32_t count;  // files holding it
+        uint64_t offset; // into the postings
+    };
+
+    static constexpr char MAGIC[8] = {'M', 'Y', 'G', 'R', 'I', 'D', 'X', '1'};
+    static constexpr size_t TRIGRAM_SPACE = size_t(1) << 24;
+
+    // Distinct trigrams of the lines in [p, p + n), appended to out. seen is
+    // a TRIGRAM_SPACE-bit scratch bitmap, left all clear again.
+    static void collect(const char *p, size_t n, std::vector<uint64_t> &seen, std::vector<uint32_t> &out);
+    static bool scan_file(const std::string &path, const struct stat &st, std::vector<uint64_t> &seen,
+                          std::vector<uint32_t> &out);
+
+    static uint32_t trigram_of(const char *s) {
+        return (uint32_t(fold(s[0])) << 16) | (uint32_t(fold(s[1])) << 8) | fold(s[2]);
+    }
+    static unsigned char fold(char c) { return ascii_fold(static_cast<unsigned char>(c)); }
+
+    const TrigramEntry *find_trigram(uint32_t t) const;
+    void postings(const TrigramEntry &e, std::vector<uint32_t> &ids) const;
+
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    const Header *header_ = nullptr;
+    const FileEntry *entries_ = nullptr;
+    const TrigramEntry *trigrams_ = nullptr;
+};
+
+inline bool TrigramIndex::open(const std::string &dir, std::string &error) {
+    close();
+    std::string file = file_in(dir);
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        error = "Could not open index " + file;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        error = "Invalid index " + file;
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        error = "Could not map index " + file;
+        return false;
+    }
+    data_ = static_cast<const char*>(data);
+    size_ = size;
+
+    const Header *h = reinterpret_cast<const Header*>(data_);
+    bool valid = std::memcmp(h->magic, MAGIC, sizeof(MAGIC)) == 0 && h->size == size &&
+                 h->files_offset + h->files * sizeof(FileEntry) <= h->paths_offset &&
+                 h->paths_offset <= h->trigrams_offset &&
+                 h->trigrams_offset + h->trigrams * sizeof(TrigramEntry) <= h->postings_offset &&
+                 h->postings_offset <= size;
+    if (!valid) {
+        close();
+        error = "Invalid index " + file;
+        return false;
+    }
+    header_ = h;
+    entries_ = reinterpret_cast<const FileEntry*>(data_ + h->files_offset);
+    trigrams_ = reinterpret_cast<const TrigramEntry*>(data_ + h->trigrams_offset);
+    return true;
+}
+
+inline void TrigramIndex::close() {
+    if (data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+    header_ = nullptr;
+    entries_ = nullptr;
+    trigrams_ = nullptr;
+}
+
+inline std::string TrigramIndex::path(size_t k) const {
+    const FileEntry &e = entries_[k];
+    return std::string(data_ + header_->paths_offset + e.path_offset, static_cast<size_t>(e.path_len));
+}
+
+inline bool TrigramIndex::fresh(size_t k, const struct stat &st) const {
+    const FileEntry &e = entries_[k];
+    return e.size == static_cast<uint64_t>(st.st_size) && e.mtime_sec == static_cast<int64_t>(st.st_mtim.tv_sec) &&
+           e.mtime_nsec == static_cast<int64_t>(st.st_mtim.tv_nsec);
+}
+
+inline const TrigramIndex::TrigramEntry *TrigramIndex::find_trigram(uint32_t t) const {
+    const TrigramEntry *end = trigrams_ + header_->trigrams;
+    const TrigramEntry *it = std::lower_bound(trigrams_, end, t,
+                                              [](const TrigramEntry &e, uint32_t v) { return e.trigram < v; });
+    return (it != end && it->trigram == t) ? it : nullptr;
+}
+
+// Decode the file ids of one trigram
+inline void TrigramIndex::postings(const TrigramEntry &e, std::vector<uint32_t> &ids) const {
+    ids.clear();
+    const unsigned char *p = reinterpret_cast<const unsigned char*>(data_ + header_->postings_offset + e.offset);
+    const unsigned char *end = reinterpret_cast<const unsigned char*>(data_ + size_);
+    uint32_t id = 0;
+    for (uint32_t k = 0; k < e.count && p < end; ++k) {
+        uint32_t delta = 0;
+        for (int shift = 0; p < end; shift += 7) {
+            unsigned char b = *p++;
+            delta |= uint32_t(b & 0x7F) << shift;
+            if ((b & 0x80) == 0) break;
+        }
+        id += delta;
+        ids.push_back(id);
+    }
+}
+
+inline std::vector<bool> TrigramIndex::candidates(const std::vector<std::string> &literals) const {
+    std::vector<bool> result(files(), false);
+    std::vector<uint32_t> acc, ids, merged;
+    for (const std::string &lit : literals) {
+        if (lit.size() < 3) return std::vector<bool>(files(), true);
+
+        // the rarest trigrams first: the intersection shrinks fastest
+        std::vector<const TrigramEntry*> entries;
+        bool missing = false;
+        for (size_t k = 0; k + 3 <= lit.size(); ++k) {
+            const TrigramEntry *e = find_trigram(trigram_of(lit.data() + k));
+            if (e == nullptr) {
+                missing = true; // no file holds this literal
+                break;
+            }
+            entries.push_back(e);
+        }
+        if (missing) continue;
+        std::sort(entries.begin(), entries.end(),
+                  [](const TrigramEntry *a, const TrigramEntry *b) { return a->count < b->count; });
+        entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+        postings(*entries[0], acc);
+        for (size_t k = 1; k < entries.size() && !acc.empty(); ++k) {
+            postings(*entries[k], ids);
+            merged.clear();
+            std::set_intersection(acc.begin(), acc.end(), ids.begin(), ids.end(), std::back_inserter(merged));
+            acc.swap(merged);
+        }
+        for (uint32_t id : acc) {
+            if (id < result.size()) result[id] = true;
+        }
+    }
+    return result;
+}
+
+inline void TrigramIndex::collect(const char *p, size_t n, std::vector<uint64_t> &seen, std::vector<uint32_t> &out) {
+    size_t start = out.size();
+    uint32_t key = 0;
+    int valid = 0; // bytes of the current line in key, up to 3
+    for (size_t k = 0; k < n; ++k) {
+        char c = p[k];
+        if (c == '\n') {
+            valid = 0;
+            continue;
+        }
+        key = ((key << 8) | fold(c)) & 0xFFFFFF;
+        if (valid < 3 && ++valid < 3) continue;
+        uint64_t bit = uint64_t(1) << (key & 63);
+        if ((seen[key >> 6] & bit) == 0) {
+            seen[key >> 6] |= bit;
+            out.push_back(key);
+        }
+    }
+    for (size_t k = start; k < out.size(); ++k) {
+        seen[out[k] >> 6] = 0;
+    }
+}
+
+inline bool TrigramIndex::scan_file(const std::string &path, const struct stat &st, std::vector<uint64_t> &seen,
+                                    std::vector<uint32_t> &out) {
+    out.clear();
+    if (st.st_size == 0) return true;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+    size_t len = static_cast<size_t>(st.st_size);
+    void *data = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) return false;
+    madvise(data, len, MADV_SEQUENTIAL);
+    collect(static_cast<const char*>(data), len, seen, out);
+    munmap(data, len);
+    std::sort(out.begin(), out.end());
+    return true;
+}
+
+inline bool TrigramIndex::build(const std::string &dir, const std::vector<std::string> &paths, BuildStats &stats,
+                                std::string &error) {
+    struct FileInfo {
+        std::string path;
+        struct stat st;
+        std::vector<uint32_t> trigrams; // sorted
+        long old_id = -1;               // same size and mtime in the previous index
+    };
+    std::vector<FileInfo> infos;
+    for (const std::string &p : paths) {
+        FileInfo info;
+        info.path = p;
+        if (stat(p.c_str(), &info.st) != 0 || !S_ISREG(info.st.st_mode)) continue;
+        infos.push_back(std::move(info));
+    }
+
+    // trigrams of unchanged files come from the previous index
+    TrigramIndex old;
+    std::string ignored;
+    if (old.open(dir, ignored)) {
+        std::unordered_map<std::string, size_t> by_path;
+        for (size_t k = 0; k < old.files(); ++k) by_path.emplace(old.path(k), k);
+        std::vector<long> reuse(old.files(), -1); // old id -> new id
+        for (size_t k = 0; k < infos.size(); ++k) {
+            auto it = by_path.find(infos[k].path);
+            if (it != by_path.end() && old.fresh(it->second, infos[k].st)) {
+                infos[k].old_id = static_cast<long>(it->second);
+                reuse[it->second] = static_cast<long>(k);
+            }
+        }
+        std::vector<uint32_t> ids;
+        for (uint64_t t = 0; t < old.header_->trigrams; ++t) {
+            old.postings(old.trigrams_[t], ids);
+            for (uint32_t id : ids) {
+                if (id < reuse.size() && reuse[id] >= 0) infos[reuse[id]].trigrams.push_back(old.trigrams_[t].trigram);
+            }
+        }
+    }
+
+    // the rest are read, on a few threads
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> scanned{0};
+    std::vector<char> unreadable(infos.size(), 0);
+    auto worker = [&]() {
+        std::vector<uint64_t> seen(TRIGRAM_SPACE / 64, 0);
+        size_t k;
+        while ((k = next.fetch_add(1)) < infos.size()) {
+            FileInfo &info = infos[k];
+            if (info.old_id >= 0) continue;
+            unreadable[k] = !scan_file(info.path, info.st, seen, info.trigrams);
+            ++scanned;
+        }
+    };
+    unsigned hw = std::thread::hardware_concurrency();
+    size_t pool_size = std::min<size_t>(std::max<size_t>(infos.size(), 1), std::min(16u, std::max(4u, hw)));
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < pool_size; ++t) pool.emplace_back(worker);
+    for (auto &t : pool) t.join();
+
+    // a file that could not be read is left out rather than never matching
+    size_t kept = 0;
+    for (size_t k = 0; k < infos.size(); ++k) {
+        if (unreadable[k]) continue;
+        if (kept != k) infos[kept] = std::move(infos[k]);
+        ++kept;
+    }
+    infos.resize(kept);
+
+    // invert: (trigram, file id) pairs sorted by trigram, then id
+    std::vector<uint64_t> pairs;
+    size_t total = 0;
+    for (const FileInfo &info : infos) total += info.trigrams.size();
+    pairs.reserve(total);
+    for (size_t k = 0; k < infos.size(); ++k) {
+        for (uint32_t t : infos[k].trigrams) pairs.push_back((uint64_t(t) << 32) | k);
+        std::vector<uint32_t>().swap(infos[k].trigrams);
+    }
+    std::sort(pairs.begin(), pairs.end());
+
+    std::vector<FileEntry> entries;
+    std::string path_bytes;
+    for (const FileInfo &info : infos) {
+        FileEntry e;
+        e.size = static_cast<uint64_t>(info.st.st_size);
+        e.mtime_sec = static_cast<int64_t>(info.st.st_mtim.tv_sec);
+        e.mtime_nsec = static_cast<int64_t>(info.st.st_mtim.tv_nsec);
+        e.path_offset = path_bytes.size();
+        e.path_len = info.path.size();
+        path_bytes += info.path;
+        entries.push_back(e);
+    }
+    while (path_bytes.size() % 8 != 0) path_bytes += '\0'; // keep the tables aligned
+
+    std::vector<TrigramEntry> table;
+    std::string posting_bytes;
+    for (size_t k = 0; k < pairs.size();) {
+        TrigramEntry e;
+        e.trigram = static_cast<uint32_t>(pairs[k] >> 32);
+        e.count = 0;
+        e.offset = posting_bytes.size();
+        uint32_t prev = 0;
+        for (; k < pairs.size() && static_cast<uint32_t>(pairs[k] >> 32) == e.trigram; ++k) {
+            uint32_t id = static_cast<uint32_t>(pairs[k]);
+            uint32_t delta = id - prev;
+            prev = id;
+            do {
+                unsigned char b = delta & 0x7F;
+                delta >>= 7;
+                posting_bytes += static_cast<char>(delta != 0 ? (b | 0x80) : b);
+            } while (delta != 0);
+            ++e.count;
+        }
+        table.push_back(e);
+    }
+
+    Header h;
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.files = entries.size();
+    h.trigrams = table.size();
+    h.files_offset = sizeof(Header);
+    h.paths_offset = h.files_offset + entries.size() * sizeof(FileEntry);
+    h.trigrams_offset = h.paths_offset + path_bytes.size();
+    h.postings_offset = h.trigrams_offset + table.size() * sizeof(TrigramEntry);
+    h.size = h.postings_offset + posting_bytes.size();
+
+    // write a temporary file and rename it over the old index, so a
+    // concurrent query never maps a half-written one
+    mkdir(dir.c_str(), 0777);
+    std::string file = file_in(dir);
+    std::string tmp = file + ".tmp." + std::to_string(getpid());
+    FILE *f = std::fopen(tmp.c_str(), "wb");
+    if (f == nullptr) {
+        error = "Could not write index " + file;
+        return false;
+    }
+    bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1 &&
+              (entries.empty() || std::fwrite(entries.data(), sizeof(FileEntry), entries.size(), f) == entries.size()) &&
+              std::fwrite(path_bytes.data(), 1, path_bytes.size(), f) == path_bytes.size() &&
+              (table.empty() || std::fwrite(table.data(), sizeof(TrigramEntry), table.size(), f) == table.size()) &&
+              std::fwrite(posting_bytes.data(), 1, posting_bytes.size(), f) == posting_bytes.size();
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), file.c_str()) != 0) {
+        unlink(tmp.c_str());
+        error = "Could not write index " + file;
+        return false;
+    }
+
+    stats.files = entries.size();
+    stats.scanned = scanned;
+    stats.trigrams = table.size();
+    return true;
+}
+
+#endif // MYINDEX_H
@@ -0,0 +1,217 @@
+#ifndef MYIO_H
+#define MYIO_H
+
+// Shared output layer for the my* tools.
+// Header-only so every tool still builds from its single .cpp with bin/compile.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <initializer_list>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/uio.h> // writev
+#include <sys/stat.h> // fstat
+
+// Buffered writer: output is collected in one large reusable buffer and handed
+// to the kernel only when the buffer fills up, on flush(), or at exit.
+// Spans that do not fit are sent together with the pending bytes in a single writev.
+// On a terminal the writer is line buffered instead: every write that ends
+// a line is flushed, so interactive output shows up as it is produced.
+// With fd -1 the writer only collects: the buffer grows instead of being
+// flushed, and data()/clear() hand the bytes to someone else.
+class OutputWriter {
+public:
+    explicit OutputWriter(int fd = STDOUT_FILENO, size_t capacity = 1 << 16)
+        : fd_(fd), buf_(capacity), len_(0), failed_(false), line_buffered_(fd >= 0 && isatty(fd)) {}
+
+    ~OutputWriter() { flush(); }
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    int fd() const { return fd_; }
+    size_t pending() const { return len_; }
+    const char *data() const { return buf_.data(); }
+    void clear() { len_ = 0; }
+
+    void write(const char *data, size_t n) {
+        append(data, n);
+        if (line_buffered_ && std::memchr(data, '\n', n) != nullptr) flush();
+    }
+
+    void put(char c) {
+        if (len_ == buf_.size()) {
+            if (fd_ < 0) {
+                buf_.resize(buf_.size() * 2);
+            } else {
+                flush();
+            }
+        }
+        buf_[len_++] = c;
+        if (line_buffered_ && c == '\n') flush();
+    }
+
+    // Write an unsigned decimal number without going through iostreams.
+    void write_uint(unsigned long long v) {
+        char tmp[20];
+        char *p = tmp + sizeof(tmp);
+        do {
+            *--p = static_cast<char>('0' + v % 10);
+            v /= 10;
+        } while (v != 0);
+        write(p, static_cast<size_t>(tmp + sizeof(tmp) - p));
+    }
+
+    // Left-aligned field, padded with spaces to width (like std::left << std::setw).
+    void write_left(const char *data, size_t n, size_t width) {
+        write(data, n);
+        for (; n < width; ++n) put(' ');
+    }
+
+    void write_left(const std::string &s, size_t width) { write_left(s.data(), s.size(), width); }
+
+    void write_left(unsigned long long v, size_t width) {
+        std::string s = std::to_string(v);
+        write_left(s.data(), s.size(), width);
+    }
+
+    OutputWriter& operator<<(const std::string &s) { write(s.data(), s.size()); return *this; }
+    OutputWriter& operator<<(const char *s) { write(s, std::strlen(s)); return *this; }
+    OutputWriter& operator<<(char c) { put(c); return *this; }
+
+    template <typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, char>::value &&
+                                                  !std::is_same<T, bool>::value, int>::type = 0>
+    OutputWriter& operator<<(T v) {
+        if (v < 0) {
+            put('-');
+            write_uint(0ULL - static_cast<unsigned long long>(v));
+        } else {
+            write_uint(static_cast<unsigned long long>(v));
+        }
+        return *this;
+    }
+
+    // Cheap when nothing is pending: call it before a read that may block
+    // (see input_may_block), so a slow producer never holds back output.
+    void flush() {
+        if (len_ == 0 || fd_ < 0) return;
+        struct iovec iov;
+        iov.iov_base = buf_.data();
+        iov.iov_len = len_;
+        writev_all(&iov, 1);
+        len_ = 0;
+    }
+
+private:
+    void append(const char *data, size_t n) {
+        if (n <= buf_.size() - len_) { // common case: fits in the buffer
+            std::memcpy(buf_.data() + len_, data, n);
+            len_ += n;
+            return;
+        }
+        if (fd_ < 0) { // collecting: make room
+            buf_.resize(std::max(buf_.size() * 2, len_ + n));
+            std::memcpy(buf_.data() + len_, data, n);
+            len_ += n;
+            return;
+        }
+        if (n < buf_.size()) { // top up, flush, keep the rest buffered
+            size_t room = buf_.size() - len_;
+            std::memcpy(buf_.data() + len_, data, room);
+            len_ += room;
+            flush();
+            std::memcpy(buf_.data(), data + room, n - room);
+            len_ = n - room;
+            return;
+        }
+
+        // large span: pending bytes + span in one syscall, no copy
+        struct iovec iov[2];
+        iov[0].iov_base = buf_.data();
+        iov[0].iov_len = len_;
+        iov[1].iov_base = const_cast<char*>(data);
+        iov[1].iov_len = n;
+        writev_all(iov, 2);
+        len_ = 0;
+    }
+
+    // keep calling writev until every iovec is consumed
+    void writev_all(struct iovec *iov, int cnt) {
+        while (cnt > 0 && !failed_) {
+            if (iov->iov_len == 0) { ++iov; --cnt; continue; }
+
+            ssize_t n = ::writev(fd_, iov, cnt);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                failed_ = true; // e.g. EPIPE: drop the rest of the output
+                return;
+            }
+            size_t done = static_cast<size_t>(n);
+            while (cnt > 0 && done >= iov->iov_len) {
+                done -= iov->iov_len;
+                ++iov;
+                --cnt;
+            }
+            if (cnt > 0) {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + done;
+                iov->iov_len -= done;
+            }
+        }
+    }
+
+    int fd_;
+    std::vector<char> buf_;
+    size_t len_;
+    bool failed_;
+    bool line_buffered_; // fd is a terminal
+};
+
+// Whether reading fd may block (pipe, FIFO, terminal, socket): callers flush
+// their output before each such read. One fstat; regular files never block.
+inline bool input_may_block(int fd) {
+    struct stat st;
+    return fstat(fd, &st) != 0 || !S_ISREG(st.st_mode);
+}
+
+// Process-wide writer for stdout, flushed when the program exits.
+inline OutputWriter& out() {
+    static OutputWriter writer(STDOUT_FILENO, 1 << 17);
+    return writer;
+}
+
+// --color=auto|always|never handling shared by the tools that colorize output.
+enum class ColorMode { Auto, Always, Never };
+
+// Returns false if arg is a --color option with an unknown value.
+inline bool parse_color_option(const std::string &arg, ColorMode &mode) {
+    if (arg == "--color" || arg == "--color=auto") {
+        mode = ColorMode::Auto;
+    } else if (arg == "--color=always") {
+        mode = ColorMode::Always;
+    } else if (arg == "--color=never") {
+        mode = ColorMode::Never;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// auto: color only when stdout is a terminal that can show it
+inline bool color_enabled(ColorMode mode) {
+    if (mode != ColorMode::Auto) return mode == ColorMode::Always;
+    if (!isatty(STDOUT_FILENO)) return false;
+    const char *term = std::getenv("TERM");
+    return term == nullptr || std::strcmp(term, "dumb") != 0;
+}
+
+// Empty a tool's ANSI color codes unless mode turns color on
+inline void apply_color_mode(ColorMode mode, std::initializer_list<std::string*> codes) {
+    if (color_enabled(mode)) return;
+    for (std::string *code : codes) code->clear();
+}
+
+#endif // MYIO_H
@@ -1,23 +1,59 @@
 #include <iostream>
-#include <filesystem>
+#include <iomanip> // std::quoted
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <algorithm>
 #include <vector>
+#include <deque>
 #include <pwd.h> // getpwuid
 #include <grp.h> // getgrgid
-#include <chrono>
 #include <ctime>
-#include <iomanip>
-#include <sys/stat.h> // stat
+#include <cerrno>
+#include <climits> // PATH_MAX
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h> // statx
+#include "myio.h"
+#include "mydir.h"
+
+// ANSI color codes, emptied in main when color is off
+std::string GREEN = "\033[01;32m";
+std::string BLUE = "\033[01;34m";
+std::string CYAN = "\033[01;36m";
+std::string PURPLE = "\033[01;35m";
+std::string RESET = "\033[0m";   // reset
+
+// One directory entry as getdents64 returns it: the name and the d_type
+// (DT_UNKNOWN already resolved), which is all the short format needs.
+struct DirEntry {
+    std::string name;
+    unsigned char type;
+};
+
+// The statx fields the long format and the -t/-S sort keys use, kept
+// compact (struct statx itself is 256 bytes)
+struct EntryStat {
+    bool ok;             // statx succeeded
+    uint32_t mode;
+    uint32_t nlink;
+    uint32_t uid;
+    uint32_t gid;
+    uint64_t size;
+    int64_t mtime_sec;
+    uint32_t mtime_nsec;
+};
 
-namespace fs = std::filesystem;
+// statx fields EntryStat is filled from
+const unsigned int ENTRY_STAT_MASK = STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_UID | STATX_GID |
+                                     STATX_SIZE | STATX_MTIME;
 
-const std::string GREEN = "\033[01;32m";
-const std::string BLUE = "\033[01;34m";
-const std::string CYAN = "\033[01;36m";
-const std::string PURPLE = "\033[01;35m";
-const std::string RESET = "\033[0m";   // reset
+// Sort key of one entry: the key proper and the entry's index
+struct SortKey {
+    uint64_t key;
+    uint32_t index;
+};
 
 struct LongFormatInfo {
     std::string permissions; // 权限字符串（如"drwxr-xr-x"）
@@ -30,13 +66,72 @@ struct LongFormatInfo {
     std::string symlink_target; // 软链接目标（非软链接为空）
 };
 
-std::string get_permissions_string(const fs::directory_entry& entry);
-std::string get_username(uid_t uid);
-std::string get_groupname(gid_t gid);
-std::string get_mtime_string(const fs::directory_entry& entry);
-void collect_long_info(const std::vector<fs::directory_entry>& entries,
-                      std::vector<LongFormatInfo>& long_entries, std::unordered_map<std::string, bool>& options);
+// uid/gid -> name, resolved once per process: getpwuid/getgrgid may be an
+// NSS round trip (LDAP, SSSD). Open addressing with linear probing over a
+// power-of-two table, grown at half load; the names are interned, so the
+// references handed out stay valid.
+class IdNameCache {
+public:
+    IdNameCache() : slots_(64) {}
+
+    const std::string* find(uint32_t id) const {
+        for (size_t k = hash(id);; k = (k + 1) & (slots_.size() - 1)) {
+            if (slots_[k].name == nullptr) return nullptr;
+            if (slots_[k].id == id) return slots_[k].name;
+        }
+    }
+
+    const std::string& insert(uint32_t id, std::string name) {
+        names_.push_back(std::move(name));
+        if (2 * (names_.size() + 1) > slots_.size()) grow();
+        place(id, &names_.back());
+        return names_.back();
+    }
+
+private:
+    struct Slot {
+        uint32_t id = 0;
+        const std::string* name = nullptr; // null: empty slot
+    };
+
+    size_t hash(uint32_t id) const { return (id * 2654435761u) & (slots_.size() - 1); }
+
+    void place(uint32_t id, const std::string* name) {
+        size_t k = hash(id);
+        while (slots_[k].name != nullptr) k = (k + 1) & (slots_.size() - 1);
+        slots_[k] = Slot{id, name};
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots_.size() * 2);
+        old.swap(slots_);
+        for (const Slot& slot : old) {
+            if (slot.name != nullptr) place(slot.id, slot.name);
+        }
+    }
+
+    std::vector<Slot> slots_;
+    std::deque<std::string> names_;
+};
+
+template <typename Fn>
+bool read_directory(int dirfd, bool all, Fn fn);
+bool list_unsorted(int dirfd, std::unordered_map<std::string, bool>& options);
+void print_short_name(int dirfd, const char* name, unsigned char type, const EntryStat* st);
+bool is_executable(int dirfd, const char* name);
+void stat_entry(int dirfd, const char* name, EntryStat& st);
+void sort_entries(std::vector<DirEntry>& entries, std::vector<EntryStat>& stats,
+                  std::unordered_map<std::string, bool>& options);
+void radix_sort(std::vector<SortKey>& keys, std::vector<SortKey>& tmp, int bytes);
+std::string get_permissions_string(uint32_t mode);
+const std::string& get_username(uid_t uid);
+const std::string& get_groupname(gid_t gid);
+const std::string& get_mtime_string(int64_t mtime_sec);
+LongFormatInfo make_long_info(int dirfd, const std::string& name, const EntryStat& file_stat);
+void collect_long_info(int dirfd, const std::vector<DirEntry>& entries, const std::vector<EntryStat>& stats,
+                      std::vector<LongFormatInfo>& long_entries);
 void print_long_format(const std::vector<LongFormatInfo>& long_entries);
+void print_long_line(const LongFormatInfo& info);
 
 int main(int argc, char *argv[]) {
     
@@ -44,9 +139,16 @@ int main(int argc, char *argv[]) {
     std::unordered_map<std::string, bool> options{
         {"--help", false}, // Display help information
         {"-a", false}, // Show all files including hidden files
-        {"-l", false} // Long format listing
+        {"-l", false}, // Long format listing
+        {"-t", false}, // Sort by modification time, newest first
+        {"-S", false}, // Sort by size, largest first
+        {"-r", false}, // Reverse the sort order
+        {"-U", false}, // Do not sort: stream entries in directory order
+        {"-f", false} // Same as -a -U
     };
 
+    ColorMode color_mode = ColorMode::Auto;
+
     // process options
     size_t i = 1;
     for (i = 1; i < argc; ++i) {
@@ -59,8 +161,19 @@ int main(int argc, char *argv[]) {
                           << "Options:\n"
                           << "  --help    Display this help information\n"
                           << "  -a        Show all files including hidden files\n"
-                          << "  -l        Long format listing\n";
+                          << "  -l        Long format listing\n"
+                          << "  -t        Sort by modification time, newest first\n"
+                          << "  -S        Sort by size, largest first (overrides -t)\n"
+                          << "  -r        Reverse the sort order\n"
+                          << "  -U        Do not sort; list entries in directory order as they are read\n"
+                          << "  -f        Same as -a -U\n"
+                          << "  --color=WHEN  Colorize output: auto (default), always, never\n";
                 return 0;
+            } else if (arg.compare(0, 7, "--color") == 0) {
+                if (!parse_color_option(arg, color_mode)) {
+                    std::cerr << "Error: Invalid argument for --color: " << arg << std::endl;
+                    return 1;
+                }
             } else {
                 
                 for (size_t j = 1; j < arg.size(); ++j) {
@@ -79,184 +192,356 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    apply_color_mode(color_mode, {&GREEN, &BLUE, &CYAN, &PURPLE, &RESET});
+
     // Determine the starting index for directory paths
-    fs::path dir_path = (argc > i) ? fs::path(argv[i]) : fs::current_path();
-    if (!fs::exists(dir_path) || !fs::is_directory(dir_path)) {
-        std::cerr << "Error: " << dir_path << " is not a valid directory." << std::endl;
+    std::string dir_path = (argc > i) ? argv[i] : ".";
+    int dirfd = open(dir_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd == -1) {
+        std::cerr << "Error: " << std::quoted(dir_path) << " is not a valid directory." << std::endl;
         return 1;
     }
 
-    // Sort the list of entries
-    std::vector<fs::directory_entry> entries;
-    for (const auto& entry : fs::directory_iterator(dir_path)) {
-        entries.push_back(entry);
+    if (options["-f"]) {
+        options["-a"] = true;
+        options["-U"] = true;
+    }
+    if (options["-U"]) { // streamed: no entry is kept after it is printed
+        bool ok = list_unsorted(dirfd, options);
+        close(dirfd);
+        if (!ok) {
+            std::cerr << "Error: Could not read directory " << dir_path << std::endl;
+            return 1;
+        }
+        return 0;
     }
-    std::sort(entries.begin(), entries.end(), [](const fs::directory_entry& a, const fs::directory_entry& b) {
-        std::string name_a = a.path().filename().string();
-        std::string name_b = b.path().filename().string();
-        std::transform(name_a.begin(), name_a.end(), name_a.begin(), ::tolower);
-        std::transform(name_b.begin(), name_b.end(), name_b.begin(), ::tolower);
-        return name_a < name_b;
+
+    // hidden files are skipped unless -a is specified
+    std::vector<DirEntry> entries;
+    bool read_ok = read_directory(dirfd, options["-a"], [&](const char* name, unsigned char type) {
+        entries.push_back(DirEntry{name, type});
     });
+    if (!read_ok) {
+        std::cerr << "Error: Could not read directory " << dir_path << std::endl;
+        return 1;
+    }
+
+    // one statx per entry, shared by the sort keys and the long format
+    std::vector<EntryStat> stats;
+    if (options["-l"] || options["-t"] || options["-S"]) {
+        stats.resize(entries.size());
+        for (size_t k = 0; k < entries.size(); ++k) {
+            stat_entry(dirfd, entries[k].name.c_str(), stats[k]);
+        }
+    }
+
+    // Sort the list of entries
+    sort_entries(entries, stats, options);
 
     // List directory contents
     if (options["-l"] == true) { // -l option for long format
 
         std::vector<LongFormatInfo> long_entries;
-        collect_long_info(entries, long_entries, options);
+        collect_long_info(dirfd, entries, stats, long_entries);
         print_long_format(long_entries);
 
     } else { // default format
 
-        for (const auto& entry : entries) {
-            std::string str = entry.path().filename().string();
-
-            // skip hidden files unless -a is specified
-            if (str[0] == '.' && options["-a"] == false) continue;
-
-            if (entry.is_symlink()) { // symbolic link
-                std::cout << CYAN << str << RESET;
-            } else if (entry.is_directory()) { // directory
-                std::cout << BLUE << str << RESET;
-            } else { // file
-                // Check executable permissions
-                fs::perms perm = fs::status(entry).permissions();
-                bool is_executable = (perm & fs::perms::owner_exec) != fs::perms::none
-                        || (perm & fs::perms::group_exec) != fs::perms::none
-                        || (perm & fs::perms::others_exec) != fs::perms::none;
-
-                if (is_executable) { // executable file
-                    std::cout << GREEN << str << RESET ;
-                } else { // regular file
-                    std::cout << str ;
-                }
-            }
-            std::cout << "  ";
+        for (size_t k = 0; k < entries.size(); ++k) {
+            print_short_name(dirfd, entries[k].name.c_str(), entries[k].type, stats.empty() ? nullptr : &stats[k]);
         }
-        std::cout << std::endl;
+        out() << '\n';
     }
 
+    close(dirfd);
     return 0;
 }
 
-std::string get_permissions_string(const fs::directory_entry& entry) {
+// Call fn(name, d_type) for every entry of the directory except "." and ".."
+// (and, unless all, the hidden ones), read with getdents64 in directory
+// order. d_type spares a stat per entry; filesystems that leave it
+// DT_UNKNOWN get one statx for the type. name is only valid during the call.
+template <typename Fn>
+bool read_directory(int dirfd, bool all, Fn fn) {
+    std::vector<char> buf(1 << 16);
+    return read_dirents(dirfd, buf, [&](const char *name, unsigned char type) {
+        if (name[0] == '.' && !all) return;
+        if (type == DT_UNKNOWN) {
+            struct statx st;
+            if (statx(dirfd, name, AT_SYMLINK_NOFOLLOW, STATX_TYPE, &st) == 0) {
+                type = S_ISLNK(st.stx_mode) ? DT_LNK : S_ISDIR(st.stx_mode) ? DT_DIR : DT_REG;
+            }
+        }
+        fn(name, type);
+    });
+}
+
+// -U: every entry is printed as soon as getdents64 returns it, so the output
+// starts at once and memory stays at one buffer of entries however large the
+// directory is. The long format is streamed the same way.
+bool list_unsorted(int dirfd, std::unordered_map<std::string, bool>& options) {
+    bool long_format = options["-l"];
+    bool ok = read_directory(dirfd, options["-a"], [&](const char* name, unsigned char type) {
+        if (long_format) {
+            EntryStat st;
+            stat_entry(dirfd, name, st);
+            print_long_line(make_long_info(dirfd, name, st));
+        } else {
+            print_short_name(dirfd, name, type, nullptr);
+        }
+    });
+    if (!long_format) out() << '\n';
+    return ok;
+}
+
+// One name of the default format, colored by type. Executables are found by
+// their mode, from st if it was collected anyway, else with a statx that is
+// only made when colors are on.
+void print_short_name(int dirfd, const char* name, unsigned char type, const EntryStat* st) {
+    if (type == DT_LNK) { // symbolic link
+        out() << CYAN << name << RESET;
+    } else if (type == DT_DIR) { // directory
+        out() << BLUE << name << RESET;
+    } else if (!GREEN.empty() && (st != nullptr ? (st->mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0
+                                                : is_executable(dirfd, name))) { // executable file
+        out() << GREEN << name << RESET;
+    } else { // regular file
+        out() << name;
+    }
+    out() << "  ";
+}
+
+// Any execute bit set (the short format's green)
+bool is_executable(int dirfd, const char* name) {
+    struct statx st;
+    if (statx(dirfd, name, 0, STATX_MODE, &st) != 0) return false;
+    return (st.stx_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0;
+}
+
+// The fields of one entry for the long format and the sort keys, with a
+// single statx that asks for nothing else. A symbolic link is described
+// itself, not its target (AT_SYMLINK_NOFOLLOW).
+void stat_entry(int dirfd, const char* name, EntryStat& st) {
+    struct statx stx;
+    if (statx(dirfd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, ENTRY_STAT_MASK, &stx) != 0) {
+        st = EntryStat{false, 0, 0, 0, 0, 0, 0, 0};
+        return;
+    }
+    st = EntryStat{true, stx.stx_mode, stx.stx_nlink, stx.stx_uid, stx.stx_gid, stx.stx_size,
+                   stx.stx_mtime.tv_sec, stx.stx_mtime.tv_nsec};
+}
+
+// Order the entries (and their stats, if collected) for output: by name
+// ignoring ASCII case, or with -t/-S newest/largest first and the name
+// breaking ties; -r reverses the result. Every key is computed once into an
+// array of key + index: the case-folded names go into one buffer and their
+// first 8 bytes into the key, so most comparisons are one integer compare.
+// Times and sizes are then ordered with a stable radix sort over that array.
+void sort_entries(std::vector<DirEntry>& entries, std::vector<EntryStat>& stats,
+                  std::unordered_map<std::string, bool>& options) {
+    size_t n = entries.size();
+    std::string folded;
+    std::vector<uint32_t> start(n + 1);
+    std::vector<SortKey> keys(n);
+    for (size_t k = 0; k < n; ++k) {
+        start[k] = static_cast<uint32_t>(folded.size());
+        uint64_t prefix = 0;
+        for (size_t c = 0; c < entries[k].name.size(); ++c) {
+            unsigned char ch = static_cast<unsigned char>(entries[k].name[c]);
+            if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
+            folded += static_cast<char>(ch);
+            if (c < 8) prefix |= uint64_t(ch) << (56 - 8 * c);
+        }
+        keys[k] = SortKey{prefix, static_cast<uint32_t>(k)};
+    }
+    start[n] = static_cast<uint32_t>(folded.size());
+
+    std::sort(keys.begin(), keys.end(), [&](const SortKey& a, const SortKey& b) {
+        if (a.key != b.key) return a.key < b.key;
+        std::string_view name_a(folded.data() + start[a.index], start[a.index + 1] - start[a.index]);
+        std::string_view name_b(folded.data() + start[b.index], start[b.index + 1] - start[b.index]);
+        int c = name_a.compare(name_b);
+        if (c != 0) return c < 0;
+        return entries[a.index].name < entries[b.index].name; // same but for case
+    });
+
+    // descending keys sort ascending as their complement; least significant part first
+    std::vector<SortKey> tmp;
+    if (options["-S"]) {
+        for (SortKey& key : keys) key.key = ~stats[key.index].size;
+        radix_sort(keys, tmp, 8);
+    } else if (options["-t"]) {
+        for (SortKey& key : keys) key.key = ~uint64_t(stats[key.index].mtime_nsec);
+        radix_sort(keys, tmp, 4);
+        for (SortKey& key : keys) key.key = ~(uint64_t(stats[key.index].mtime_sec) ^ (uint64_t(1) << 63));
+        radix_sort(keys, tmp, 8);
+    }
+    if (options["-r"]) std::reverse(keys.begin(), keys.end());
+
+    std::vector<DirEntry> sorted(n);
+    for (size_t k = 0; k < n; ++k) sorted[k] = std::move(entries[keys[k].index]);
+    entries.swap(sorted);
+    if (!stats.empty()) {
+        std::vector<EntryStat> sorted_stats(n);
+        for (size_t k = 0; k < n; ++k) sorted_stats[k] = stats[keys[k].index];
+        stats.swap(sorted_stats);
+    }
+}
+
+// Stable LSD radix sort of keys by the low bytes of key, one byte per pass;
+// a pass over a byte that is the same in every key is skipped.
+void radix_sort(std::vector<SortKey>& keys, std::vector<SortKey>& tmp, int bytes) {
+    tmp.resize(keys.size());
+    for (int shift = 0; shift < 8 * bytes; shift += 8) {
+        size_t count[257] = {0};
+        for (const SortKey& key : keys) ++count[((key.key >> shift) & 0xFF) + 1];
+        if (std::find(count + 1, count + 257, keys.size()) != count + 257) continue;
+        for (int b = 0; b < 256; ++b) count[b + 1] += count[b];
+        for (const SortKey& key : keys) tmp[count[(key.key >> shift) & 0xFF]++] = key;
+        keys.swap(tmp);
+    }
+}
+
+std::string get_permissions_string(uint32_t p) {
     std::string perm_str(10, '-'); // 10位：类型+9权限位
 
     // 第0位：文件类型
-    if (entry.is_directory()) perm_str[0] = 'd';
-    else if (entry.is_symlink()) perm_str[0] = 'l';
-    else if (entry.is_regular_file()) perm_str[0] = '-';
+    if (S_ISDIR(p)) perm_str[0] = 'd';
+    else if (S_ISLNK(p)) perm_str[0] = 'l';
+    else if (S_ISREG(p)) perm_str[0] = '-';
     else perm_str[0] = '?';
 
-    // 获取权限位
-    fs::perms p;
-    if (entry.is_symlink()) {
-        p = fs::symlink_status(entry).permissions(); // 软链接自身权限
-    } else {
-        p = fs::status(entry).permissions(); // 非软链接用目标权限
-    }
-
     // 所有者权限（1-3位）
-    perm_str[1] = ((p & fs::perms::owner_read) != fs::perms::none) ? 'r' : '-';
-    perm_str[2] = ((p & fs::perms::owner_write) != fs::perms::none) ? 'w' : '-';
-    perm_str[3] = ((p & fs::perms::owner_exec) != fs::perms::none) ? 'x' : '-';
+    perm_str[1] = (p & S_IRUSR) ? 'r' : '-';
+    perm_str[2] = (p & S_IWUSR) ? 'w' : '-';
+    perm_str[3] = (p & S_IXUSR) ? 'x' : '-';
 
     // 组权限（4-6位）
-    perm_str[4] = ((p & fs::perms::group_read) != fs::perms::none) ? 'r' : '-';
-    perm_str[5] = ((p & fs::perms::group_write) != fs::perms::none) ? 'w' : '-';
-    perm_str[6] = ((p & fs::perms::group_exec) != fs::perms::none) ? 'x' : '-';
+    perm_str[4] = (p & S_IRGRP) ? 'r' : '-';
+    perm_str[5] = (p & S_IWGRP) ? 'w' : '-';
+    perm_str[6] = (p & S_IXGRP) ? 'x' : '-';
 
     // 其他用户权限（7-9位）
-    perm_str[7] = ((p & fs::perms::others_read) != fs::perms::none) ? 'r' : '-';
-    perm_str[8] = ((p & fs::perms::others_write) != fs::perms::none) ? 'w' : '-';
-    perm_str[9] = ((p & fs::perms::others_exec) != fs::perms::none) ? 'x' : '-';
+    perm_str[7] = (p & S_IROTH) ? 'r' : '-';
+    perm_str[8] = (p & S_IWOTH) ? 'w' : '-';
+    perm_str[9] = (p & S_IXOTH) ? 'x' : '-';
 
     return perm_str;
 }
 
-std::string get_username(uid_t uid) {
+const std::string& get_username(uid_t uid) {
+    static IdNameCache cache;
+    if (const std::string* name = cache.find(uid)) return *name;
     struct passwd* pw = getpwuid(uid);
-    return (pw != nullptr) ? pw->pw_name : std::to_string(uid);
+    return cache.insert(uid, (pw != nullptr) ? pw->pw_name : std::to_string(uid));
 }
 
 // 通过组ID获取组名
-std::string get_groupname(gid_t gid) {
+const std::string& get_groupname(gid_t gid) {
+    static IdNameCache cache;
+    if (const std::string* name = cache.find(gid)) return *name;
     struct group* gr = getgrgid(gid);
-    return (gr != nullptr) ? gr->gr_name : std::to_string(gid);
+    return cache.insert(gid, (gr != nullptr) ? gr->gr_name : std::to_string(gid));
 }
 
-std::string get_mtime_string(const fs::directory_entry& entry) {
-    auto ftime = fs::last_write_time(entry);
-    using namespace std::chrono;
-    auto sys_time = system_clock::to_time_t(
-        system_clock::time_point(duration_cast<system_clock::duration>(ftime.time_since_epoch()))
-    );
-    struct tm* local_tm = localtime(&sys_time);
-    if (local_tm == nullptr) { // 处理转换失败
-        return "Invalid time";
+// "%b %d %H:%M" of the local time. Entries of the same local minute share one
+// formatted string from a small direct-mapped cache (bounded, however many
+// entries there are). A slot remembers where its local minute starts in UTC
+// seconds, which need not be a multiple of 60 (e.g. a -0:44:30 offset). On a miss the time zone, loaded once by tzset(), is
+// applied with localtime_r (localtime re-checks it on every call) and the
+// text is built by hand instead of through strftime.
+const std::string& get_mtime_string(int64_t mtime_sec) {
+    static const char MONTHS[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                       "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    static const std::string INVALID = "Invalid time";
+    struct Slot {
+        int64_t start = INT64_MIN; // the local minute is [start, start + 60)
+        std::string text;
+    };
+    static std::vector<Slot> cache(1024);
+    static bool zone_loaded = false;
+
+    int64_t minute = mtime_sec >= 0 ? mtime_sec / 60 : (mtime_sec - 59) / 60; // floor
+    Slot& slot = cache[static_cast<uint64_t>(minute) & (cache.size() - 1)];
+    if (slot.start <= mtime_sec && mtime_sec < slot.start + 60) return slot.text;
+
+    if (!zone_loaded) {
+        tzset();
+        zone_loaded = true;
+    }
+    time_t sys_time = static_cast<time_t>(mtime_sec);
+    struct tm local_tm;
+    if (localtime_r(&sys_time, &local_tm) == nullptr) { // 处理转换失败
+        return INVALID;
     }
-    char buf[20];
-    strftime(buf, sizeof(buf), "%b %d %H:%M", local_tm);
-    return buf;
+    char buf[12] = {MONTHS[local_tm.tm_mon][0], MONTHS[local_tm.tm_mon][1], MONTHS[local_tm.tm_mon][2], ' ',
+                    static_cast<char>('0' + local_tm.tm_mday / 10), static_cast<char>('0' + local_tm.tm_mday % 10), ' ',
+                    static_cast<char>('0' + local_tm.tm_hour / 10), static_cast<char>('0' + local_tm.tm_hour % 10), ':',
+                    static_cast<char>('0' + local_tm.tm_min / 10), static_cast<char>('0' + local_tm.tm_min % 10)};
+    slot.start = mtime_sec - local_tm.tm_sec;
+    slot.text.assign(buf, sizeof(buf));
+    return slot.text;
 }
 
-void collect_long_info(const std::vector<fs::directory_entry>& entries,
-                      std::vector<LongFormatInfo>& long_entries, std::unordered_map<std::string, bool>& options) {
-    for (const auto& entry : entries) {
-        std::string name = entry.path().filename().string();
-        if (name[0] == '.' && !options["-a"]) continue; // 结合-a选项
-
-        // 新增：用stat获取文件元信息（包括uid和gid）
-        struct stat file_stat;
-        if (stat(entry.path().c_str(), &file_stat) != 0) {
-            // 处理获取失败的情况（如权限不足）
-            long_entries.push_back({"...", 0, "?", "?", 0, "", name, ""});
-            continue;
-        }
+void collect_long_info(int dirfd, const std::vector<DirEntry>& entries, const std::vector<EntryStat>& stats,
+                      std::vector<LongFormatInfo>& long_entries) {
+    for (size_t k = 0; k < entries.size(); ++k) {
+        long_entries.push_back(make_long_info(dirfd, entries[k].name, stats[k])); // 每个条目一次statx（stat_entry）
+    }
+}
 
-        LongFormatInfo info;
-        info.permissions = get_permissions_string(entry);
-        info.link_count = file_stat.st_nlink;  // 用stat的硬链接数
-        info.owner = get_username(file_stat.st_uid);  // 从stat获取uid
-        info.group = get_groupname(file_stat.st_gid); // 从stat获取gid
-        info.size = file_stat.st_size;
-        info.mtime = get_mtime_string(entry);
-
-        // 文件名颜色逻辑不变...
-        if (entry.is_symlink()) {
-            info.name = CYAN + name + RESET;
-            info.symlink_target = fs::read_symlink(entry.path()).string();
-        } else if (entry.is_directory()) {
-            info.name = BLUE + name + RESET;
-        } else {
-            fs::perms perm = fs::status(entry).permissions();
-            bool is_exec = (perm & fs::perms::owner_exec) != fs::perms::none;
-            info.name = is_exec ? (GREEN + name + RESET) : name;
-        }
+// 一个条目的长格式信息（file_stat来自stat_entry）
+LongFormatInfo make_long_info(int dirfd, const std::string& name, const EntryStat& file_stat) {
+    if (!file_stat.ok) {
+        // 处理获取失败的情况（如权限不足）
+        return {"...", 0, "?", "?", 0, "", name, ""};
+    }
 
-        long_entries.push_back(info);
+    LongFormatInfo info;
+    info.permissions = get_permissions_string(file_stat.mode);
+    info.link_count = file_stat.nlink;
+    info.owner = get_username(file_stat.uid);
+    info.group = get_groupname(file_stat.gid);
+    info.size = file_stat.size;
+    info.mtime = get_mtime_string(file_stat.mtime_sec);
+
+    // 文件名颜色
+    if (S_ISLNK(file_stat.mode)) {
+        info.name = CYAN + name + RESET;
+        char target[PATH_MAX];
+        ssize_t len = readlinkat(dirfd, name.c_str(), target, sizeof(target));
+        if (len > 0) info.symlink_target.assign(target, static_cast<size_t>(len));
+    } else if (S_ISDIR(file_stat.mode)) {
+        info.name = BLUE + name + RESET;
+    } else {
+        bool is_exec = (file_stat.mode & S_IXUSR) != 0;
+        info.name = is_exec ? (GREEN + name + RESET) : name;
     }
+    return info;
 }
 
 void print_long_format(const std::vector<LongFormatInfo>& long_entries) {
     for (const auto& info : long_entries) {
-        // 按列对齐输出（用setw控制宽度）
-        std::cout << std::left
-                  << std::setw(11) << info.permissions  // 权限（10位+空格）
-                  << std::right
-                  << info.link_count    // 链接数
-                  << " " << std::left
-                  << std::setw(4) << info.owner         // 所有者
-                  << " "
-                  << std::setw(4) << info.group         // 组
-                  << " " << std::setw(8) << info.size          // 大小
-                  << std::setw(12) << info.mtime        // 修改时间
-                  << " " << info.name;                         // 文件名
-
-        // 软链接额外显示" -> 目标"
-        if (!info.symlink_target.empty()) {
-            std::cout << " -> " << info.symlink_target;
-        }
-        std::cout << std::endl;
+        print_long_line(info);
     }
-}
\ No newline at end of file
+}
+
+void print_long_line(const LongFormatInfo& info) {
+    OutputWriter& w = out();
+    // 按列对齐输出（左对齐并补空格到列宽）
+    w.write_left(info.permissions, 11);     // 权限（10位+空格）
+    w << info.link_count << ' ';            // 链接数
+    w.write_left(info.owner, 4);            // 所有者
+    w << ' ';
+    w.write_left(info.group, 4);            // 组
+    w << ' ';
+    w.write_left(info.size, 8);             // 大小
+    w.write_left(info.mtime, 12);           // 修改时间
+    w << ' ' << info.name;                  // 文件名
+
+    // 软链接额外显示" -> 目标"
+    if (!info.symlink_target.empty()) {
+        w << " -> " << info.symlink_target;
+    }
+    w << '\n';
+}
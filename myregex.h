@@ -0,0 +1,1135 @@
+#ifndef MYREGEX_H
+#define MYREGEX_H
+
+// Regular expressions for mygrep -E/-G: POSIX ERE and BRE syntax (with the
+// usual GNU extensions \| \+ \? in BRE and \w \W \s \S in both) parsed into a
+// Thompson NFA and run as a lazily built, cached DFA. A match never contains
+// '\n', so a whole buffer of lines can be scanned in one pass.
+// Where a match starts is found by a second DFA, built from the reversed
+// pattern, that reads the line backward.
+//
+// Before the DFA runs, a prefilter looks for literals that every match must
+// contain (one literal: LiteralSearcher, several: AhoCorasick), so lines
+// without them are skipped at substring-search speed.
+//
+// Back-references and word-boundary assertions are not supported: they do
+// not fit a DFA. Header-only like myio.h.
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include "mysearch.h"
+
+class Regex {
+public:
+    static constexpr size_t npos = std::string::npos;
+
+    Regex() = default;
+    Regex(const Regex&) = delete; // the DFA caches point back at their Regex
+    Regex& operator=(const Regex&) = delete;
+
+    // Compile the alternation of patterns. extended selects ERE over BRE.
+    // On failure returns false and describes the problem in error.
+    bool compile(const std::vector<std::string> &patterns, bool extended, bool ignore_case, std::string &error);
+
+    // Leftmost match at or after from (the longest one there), as for
+    // LiteralSearcher and AhoCorasick. A line boundary is any '\n' and the
+    // two ends of hay, but no empty line follows a final '\n'. The match may
+    // be empty (e.g. "a*").
+    bool find(const char *hay, size_t n, size_t from, size_t &begin, size_t &len) const;
+
+    // Where the first match at or after from ends (not the leftmost-longest
+    // one: the first to end), or npos. Enough to tell which line matches.
+    size_t first_end(const char *hay, size_t n, size_t from) const;
+
+    // Literals of which every match contains at least one (empty: no prefilter)
+    const std::vector<std::string> &required_literals() const { return literals_; }
+
+private:
+    // 256-bit byte set
+    struct ByteSet {
+        uint64_t w[4] = {0, 0, 0, 0};
+        void add(unsigned c) { w[c >> 6] |= uint64_t(1) << (c & 63); }
+        bool has(unsigned c) const { return (w[c >> 6] >> (c & 63)) & 1; }
+        void add_range(unsigned lo, unsigned hi) { for (unsigned c = lo; c <= hi; ++c) add(c); }
+        void invert() { for (uint64_t &x : w) x = ~x; }
+        void merge(const ByteSet &o) { for (int k = 0; k < 4; ++k) w[k] |= o.w[k]; }
+        size_t count() const {
+            size_t n = 0;
+            for (uint64_t x : w) n += static_cast<size_t>(__builtin_popcountll(x));
+            return n;
+        }
+    };
+
+    // Parse tree
+    struct Node {
+        enum Kind { Empty, Set, Begin, End, Concat, Alt, Repeat } kind;
+        ByteSet set;            // Set
+        std::vector<int> kids;  // Concat, Alt, Repeat (one kid)
+        int min = 0, max = 0;   // Repeat; max < 0 is unbounded
+    };
+
+    class Parser;
+
+    // NFA: Byte consumes one byte of a set, Nop is an epsilon move (to out and,
+    // if set, out1), Begin/End assert a line boundary, Match accepts.
+    struct NState {
+        enum Kind : uint8_t { Byte, Nop, Begin, End, Match } kind;
+        int out = -1;
+        int out1 = -1;
+        int set = -1; // Byte: index into sets_
+    };
+
+    struct Frag {
+        int start;
+        int end; // a Nop whose out is still free
+    };
+
+    static constexpr size_t MAX_NFA_STATES = 200000;
+    static constexpr int MAX_REPEAT = 255; // RE_DUP_MAX
+
+    int add_state(NState::Kind kind, int set = -1) {
+        NState s;
+        s.kind = kind;
+        s.set = set;
+        nfa_.push_back(s);
+        return static_cast<int>(nfa_.size() - 1);
+    }
+    bool build(const std::vector<Node> &tree, int node, Frag &frag, std::string &error);
+    bool build_nfa(const std::vector<Node> &tree, int root, std::string &error);
+    void make_classes();
+
+    // Required literals: exact is the full set of strings a node can match
+    // when that set is small, req a set of which every match contains one.
+    struct Literals {
+        bool exact_known = false;
+        std::vector<std::string> exact;
+        std::vector<std::string> req;    // empty: nothing known
+        std::vector<std::string> repeat; // X+ / X{m,} of an exact X: the first copy
+                                         // ends a run, the last one starts the next
+    };
+    Literals literals(const std::vector<Node> &tree, int node) const;
+    static void better(std::vector<std::string> &best, const std::vector<std::string> &cand);
+
+    // Lazily built DFA over byte classes. Unanchored DFAs restart the NFA at
+    // every position (searching); anchored ones follow a match from one start.
+    class Dfa {
+    public:
+        static constexpr uint32_t MATCH = 0x80000000u;  // transition flag: a match ends here
+        static constexpr uint32_t UNKNOWN = 0x7FFFFFFFu; // transition not built yet
+        static constexpr size_t MAX_STATES = 4096;      // then the cache is flushed
+
+        void init(const Regex *re, bool unanchored) {
+            re_ = re;
+            unanchored_ = unanchored;
+            flush();
+        }
+
+        // States are premultiplied by the class count: next = table[s + class]
+        uint32_t start(bool at_line_begin);
+        uint32_t step(uint32_t s, unsigned char c) {
+            uint32_t v = table_[s + re_->classes_[c]];
+            return v != UNKNOWN ? v : build(s, c);
+        }
+        bool matches(uint32_t s) const { return flags_[s / stride_] & F_MATCH; }
+        bool matches_at_eol(uint32_t s) const { return flags_[s / stride_] & F_EOL_MATCH; }
+        bool dead(uint32_t s) const { return flags_[s / stride_] & F_DEAD; }
+        const uint32_t *table() const { return table_.data(); }
+
+        // The state of this DFA for the NFA states of state s of other
+        uint32_t adopt(const Dfa &other, uint32_t s) {
+            std::vector<int> set = other.sets_[s / other.stride_];
+            return intern(set);
+        }
+
+    private:
+        enum { F_MATCH = 1, F_EOL_MATCH = 2, F_DEAD = 4 };
+
+        void flush();
+        uint32_t intern(std::vector<int> &set);
+        uint32_t build(uint32_t s, unsigned char c);
+
+        const Regex *re_ = nullptr;
+        bool unanchored_ = false;
+        size_t flushes_ = 0;
+        size_t stride_ = 1;
+        std::vector<uint32_t> table_;
+        std::vector<uint8_t> flags_;
+        std::vector<std::vector<int>> sets_;
+        std::unordered_map<std::string, uint32_t> ids_; // NFA state set (as bytes) -> state
+        uint32_t start_[2] = {UNKNOWN, UNKNOWN};
+    };
+
+    // NFA helpers used by the DFA
+    void closure(std::vector<int> &set, bool at_line_begin, bool at_line_end) const;
+    bool set_matches(const std::vector<int> &set, bool at_line_end) const;
+
+    size_t scan(const char *hay, size_t n, size_t from) const;
+    size_t scan_dfa(const char *hay, size_t n, size_t from) const;
+    size_t longest_at(const char *hay, size_t line_end, size_t s) const;
+    size_t reach(const char *hay, size_t line, size_t line_end, size_t end) const;
+    size_t leftmost_start(const char *hay, size_t line, size_t line_end, size_t reach) const;
+
+    std::vector<NState> nfa_;
+    std::vector<ByteSet> sets_;
+    int start_state_ = -1;
+    bool icase_ = false;
+    bool reversed_ = false;       // built for reading right to left: ^ and $ swap
+    bool empty_at_begin_ = false; // the empty string matches at a line start
+    bool empty_line_ = false;     // ... or at least on an empty line (e.g. "^$", "$^")
+    uint8_t classes_[256];
+    size_t num_classes_ = 1;
+
+    std::vector<std::string> literals_;
+    std::shared_ptr<const LiteralSearcher> single_;
+    std::shared_ptr<const AhoCorasick> multi_;
+
+    mutable Dfa search_dfa_;   // unanchored: where does the first match end
+    mutable Dfa anchored_dfa_; // from a given start: how far does the match reach
+    std::unique_ptr<Regex> reverse_; // its search DFA, run backward, finds where matches start
+    mutable std::vector<int> stack_;
+    mutable std::vector<uint32_t> mark_;
+    mutable uint32_t generation_ = 0;
+};
+
+// Recursive-descent parser for both syntaxes. In BRE the operators are
+// \( \) \{ \} \| \+ \? and *; in ERE ( ) { } | + ? *.
+class Regex::Parser {
+public:
+    Parser(const std::string &p, bool extended, bool ignore_case, std::vector<Node> &tree)
+        : p_(p), ere_(extended), icase_(ignore_case), tree_(tree) {}
+
+    int parse(std::string &error) {
+        int root = alternation();
+        if (error_.empty() && pos_ < p_.size()) {
+            error_ = "Unmatched ) or \\)";
+        }
+        error = error_;
+        return error_.empty() ? root : -1;
+    }
+
+private:
+    int add(Node::Kind kind) {
+        Node n;
+        n.kind = kind;
+        tree_.push_back(n);
+        return static_cast<int>(tree_.size() - 1);
+    }
+
+    // -i: a letter in the set brings its other case along
+    void fold(ByteSet &s) const {
+        if (!icase_) return;
+        for (unsigned c = 'a'; c <= 'z'; ++c) {
+            if (s.has(c) || s.has(c - 0x20)) {
+                s.add(c);
+                s.add(c - 0x20);
+            }
+        }
+    }
+
+    int add_set(const ByteSet &set) {
+        int id = add(Node::Set);
+        ByteSet s = set;
+        fold(s);
+        s.w['\n' >> 6] &= ~(uint64_t(1) << ('\n' & 63)); // matches never span lines
+        tree_[id].set = s;
+        return id;
+    }
+
+    int add_byte(unsigned char c) {
+        ByteSet s;
+        s.add(c);
+        return add_set(s);
+    }
+
+    bool at_end() const { return pos_ >= p_.size(); }
+    bool peek(const char *tok) const { return p_.compare(pos_, std::strlen(tok), tok) == 0; }
+
+    bool at_alt() const { return ere_ ? peek("|") : peek("\\|"); }
+    bool at_close() const { return ere_ ? (peek(")") && depth_ > 0) : peek("\\)"); }
+
+    int alternation() {
+        std::vector<int> branches;
+        branches.push_back(concatenation());
+        while (error_.empty() && at_alt()) {
+            pos_ += ere_ ? 1 : 2;
+            branches.push_back(concatenation());
+        }
+        if (branches.size() == 1) return branches[0];
+        int id = add(Node::Alt);
+        tree_[id].kids = branches;
+        return id;
+    }
+
+    int concatenation() {
+        std::vector<int> items;
+        bool branch_start = true; // BRE: still true after a leading ^, so "^*" is a literal '*'
+        while (error_.empty() && !at_end() && !at_alt() && !at_close()) {
+            int item = repetition(branch_start);
+            branch_start = !ere_ && branch_start && item >= 0 && tree_[item].kind == Node::Begin;
+            if (item >= 0) items.push_back(item);
+        }
+        if (items.empty()) return add(Node::Empty);
+        if (items.size() == 1) return items[0];
+        int id = add(Node::Concat);
+        tree_[id].kids = items;
+        return id;
+    }
+
+    // One atom and the repetition operators after it
+    int repetition(bool branch_start) {
+        int atom = this->atom(branch_start);
+        if (atom < 0) return atom;
+        if (!ere_ && tree_[atom].kind == Node::Begin) return atom; // a BRE anchor is not repeated
+
+        while (error_.empty() && !at_end()) {
+            int min, max;
+            if (peek("*")) {
+                pos_ += 1;
+                min = 0;
+                max = -1;
+            } else if (ere_ ? peek("+") : peek("\\+")) {
+                pos_ += ere_ ? 1 : 2;
+                min = 1;
+                max = -1;
+            } else if (ere_ ? peek("?") : peek("\\?")) {
+                pos_ += ere_ ? 1 : 2;
+                min = 0;
+                max = 1;
+            } else if (ere_ ? (peek("{") && interval_follows(pos_ + 1)) : peek("\\{")) {
+                pos_ += ere_ ? 1 : 2;
+                if (!interval(min, max)) return -1;
+            } else {
+                break;
+            }
+            int id = add(Node::Repeat);
+            tree_[id].kids.push_back(atom);
+            tree_[id].min = min;
+            tree_[id].max = max;
+            atom = id;
+        }
+        return atom;
+    }
+
+    bool interval_follows(size_t at) const {
+        return at < p_.size() && (std::isdigit(static_cast<unsigned char>(p_[at])) || p_[at] == ',');
+    }
+
+    // {m}, {m,}, {m,n} or {,n}; pos_ is just past the opening brace
+    bool interval(int &min, int &max) {
+        auto number = [&](int &v) {
+            if (at_end() || !std::isdigit(static_cast<unsigned char>(p_[pos_]))) return false;
+            v = 0;
+            while (!at_end() && std::isdigit(static_cast<unsigned char>(p_[pos_]))) {
+                v = v * 10 + (p_[pos_++] - '0');
+                if (v > MAX_REPEAT) v = MAX_REPEAT + 1;
+            }
+            return true;
+        };
+        bool has_min = number(min);
+        if (!has_min) min = 0;
+        max = min;
+        if (!at_end() && p_[pos_] == ',') {
+            ++pos_;
+            if (!number(max)) max = -1;
+        } else if (!has_min) {
+            error_ = "Invalid content of \\{\\}";
+            return false;
+        }
+        if (ere_ ? !peek("}") : !peek("\\}")) {
+            error_ = "Unmatched { or \\{";
+            return false;
+        }
+        pos_ += ere_ ? 1 : 2;
+        if (min > MAX_REPEAT || max > MAX_REPEAT) {
+            error_ = "Regular expression too big";
+            return false;
+        }
+        if (max >= 0 && max < min) {
+            error_ = "Invalid content of \\{\\}";
+            return false;
+        }
+        return true;
+    }
+
+    int atom(bool branch_start) {
+        unsigned char c = static_cast<unsigned char>(p_[pos_]);
+
+        // a repetition operator with nothing before it is an ordinary character
+        if (branch_start && (c == '*' || (ere_ && (c == '+' || c == '?' || c == '{')))) {
+            ++pos_;
+            return add_byte(c);
+        }
+
+        if (ere_ ? c == '(' : peek("\\(")) {
+            pos_ += ere_ ? 1 : 2;
+            ++depth_;
+            int inner = alternation();
+            --depth_;
+            if (!error_.empty()) return -1;
+            if (ere_ ? !peek(")") : !peek("\\)")) {
+                error_ = "Unmatched ( or \\(";
+                return -1;
+            }
+            pos_ += ere_ ? 1 : 2;
+            return inner;
+        }
+        if (c == '^' && (ere_ || branch_start)) {
+            ++pos_;
+            return add(Node::Begin);
+        }
+        if (c == '$' && (ere_ || bre_branch_end(pos_ + 1))) {
+            ++pos_;
+            return add(Node::End);
+        }
+        if (c == '.') {
+            ++pos_;
+            ByteSet all;
+            all.invert();
+            return add_set(all);
+        }
+        if (c == '[') {
+            ++pos_;
+            return bracket();
+        }
+        if (c == '\\') {
+            return escape();
+        }
+        ++pos_;
+        return add_byte(c);
+    }
+
+    bool bre_branch_end(size_t at) const {
+        return at >= p_.size() || p_.compare(at, 2, "\\)") == 0 || p_.compare(at, 2, "\\|") == 0;
+    }
+
+    int escape() {
+        if (pos_ + 1 >= p_.size()) {
+            error_ = "Trailing backslash";
+            return -1;
+        }
+        unsigned char c = static_cast<unsigned char>(p_[pos_ + 1]);
+        pos_ += 2;
+
+        ByteSet set;
+        switch (c) {
+        case 'w': case 'W':
+            set.add_range('a', 'z');
+            set.add_range('A', 'Z');
+            set.add_range('0', '9');
+            set.add('_');
+            if (c == 'W') set.invert();
+            return add_set(set);
+        case 's': case 'S':
+            set.add(' ');
+            set.add_range('\t', '\r');
+            if (c == 'S') set.invert();
+            return add_set(set);
+        case 'b': case 'B': case '<': case '>': case '`': case '\'':
+            error_ = std::string("Unsupported assertion \\") + static_cast<char>(c);
+            return -1;
+        default:
+            if (c >= '1' && c <= '9') {
+                error_ = "Back-references are not supported";
+                return -1;
+            }
+            return add_byte(c); // \. \* \\ ... and unknown escapes stand for the character
+        }
+    }
+
+    // Bracket expression; pos_ is just past '['
+    int bracket() {
+        ByteSet set;
+        bool negate = false;
+        if (!at_end() && p_[pos_] == '^') {
+            negate = true;
+            ++pos_;
+        }
+        bool first = true;
+        while (true) {
+            if (at_end()) {
+                error_ = "Unmatched [, [^, [:, [., or [=";
+                return -1;
+            }
+            unsigned char c = static_cast<unsigned char>(p_[pos_]);
+            if (c == ']' && !first) {
+                ++pos_;
+                break;
+            }
+            first = false;
+
+            if (c == '[' && pos_ + 1 < p_.size() && (p_[pos_ + 1] == ':' || p_[pos_ + 1] == '.' || p_[pos_ + 1] == '=')) {
+                char kind = p_[pos_ + 1];
+                size_t close = p_.find(std::string(1, kind) + "]", pos_ + 2);
+                if (close == std::string::npos) {
+                    error_ = "Unmatched [, [^, [:, [., or [=";
+                    return -1;
+                }
+                std::string name = p_.substr(pos_ + 2, close - pos_ - 2);
+                pos_ = close + 2;
+                if (kind == ':') {
+                    if (!named_class(name, set)) {
+                        error_ = "Invalid character class name";
+                        return -1;
+                    }
+                } else if (name.size() == 1) { // [.x.] and [=x=] of a single byte
+                    set.add(static_cast<unsigned char>(name[0]));
+                } else {
+                    error_ = "Invalid collation character";
+                    return -1;
+                }
+                continue;
+            }
+
+            ++pos_;
+            unsigned lo = c;
+            if (pos_ + 1 < p_.size() && p_[pos_] == '-' && p_[pos_ + 1] != ']') {
+                unsigned hi = static_cast<unsigned char>(p_[pos_ + 1]);
+                pos_ += 2;
+                if (hi < lo) {
+                    error_ = "Invalid range end";
+                    return -1;
+                }
+                set.add_range(lo, hi);
+            } else {
+                set.add(lo);
+            }
+        }
+        fold(set); // before negating, so [^a] excludes 'A' too
+        if (negate) set.invert();
+        return add_set(set);
+    }
+
+    static bool named_class(const std::string &name, ByteSet &set) {
+        int (*pred)(int) = nullptr;
+        if (name == "alpha") pred = isalpha;
+        else if (name == "digit") pred = isdigit;
+        else if (name == "alnum") pred = isalnum;
+        else if (name == "upper") pred = isupper;
+        else if (name == "lower") pred = islower;
+        else if (name == "space") pred = isspace;
+        else if (name == "blank") pred = isblank;
+        else if (name == "punct") pred = ispunct;
+        else if (name == "print") pred = isprint;
+        else if (name == "graph") pred = isgraph;
+        else if (name == "cntrl") pred = iscntrl;
+        else if (name == "xdigit") pred = isxdigit;
+        else return false;
+        for (unsigned c = 0; c < 128; ++c) { // the C locale
+            if (pred(static_cast<int>(c))) set.add(c);
+        }
+        return true;
+    }
+
+    const std::string &p_;
+    bool ere_;
+    bool icase_;
+    std::vector<Node> &tree_;
+    size_t pos_ = 0;
+    int depth_ = 0;
+    std::string error_;
+};
+
+inline bool Regex::compile(const std::vector<std::string> &patterns, bool extended, bool ignore_case,
+                           std::string &error) {
+    icase_ = ignore_case;
+    std::vector<Node> tree;
+    std::vector<int> roots;
+    for (const std::string &p : patterns) {
+        Parser parser(p, extended, ignore_case, tree);
+        int root = parser.parse(error);
+        if (root < 0) return false;
+        roots.push_back(root);
+    }
+    int root = roots.empty() ? -1 : roots[0];
+    if (roots.size() != 1) {
+        Node alt;
+        alt.kind = Node::Alt;
+        alt.kids = roots;
+        tree.push_back(alt);
+        root = static_cast<int>(tree.size() - 1);
+    }
+
+    if (!build_nfa(tree, root, error)) return false;
+    reverse_.reset(new Regex);
+    reverse_->reversed_ = true;
+    if (!reverse_->build_nfa(tree, root, error)) return false;
+    reverse_->search_dfa_.init(reverse_.get(), true);
+
+    // prefilter
+    Literals lit = literals(tree, root);
+    literals_ = lit.exact_known ? lit.exact : lit.req;
+    for (const std::string &s : literals_) {
+        if (s.empty()) {
+            literals_.clear();
+            break;
+        }
+    }
+    single_.reset();
+    multi_.reset();
+    if (literals_.size() == 1) {
+        single_ = std::make_shared<LiteralSearcher>(literals_[0], ignore_case);
+    } else if (literals_.size() > 1) {
+        multi_ = std::make_shared<AhoCorasick>(literals_, ignore_case);
+    }
+
+    std::vector<int> begin(1, start_state_);
+    closure(begin, true, false);
+    empty_at_begin_ = set_matches(begin, false);
+    closure(begin, true, true);
+    empty_line_ = set_matches(begin, false);
+
+    search_dfa_.init(this, true);
+    anchored_dfa_.init(this, false);
+    return true;
+}
+
+inline bool Regex::build_nfa(const std::vector<Node> &tree, int root, std::string &error) {
+    nfa_.clear();
+    sets_.clear();
+    Frag frag;
+    if (!build(tree, root, frag, error)) return false;
+    int match = add_state(NState::Match);
+    nfa_[frag.end].out = match;
+    start_state_ = frag.start;
+    make_classes();
+    mark_.assign(nfa_.size(), 0);
+    generation_ = 0;
+    return true;
+}
+
+inline bool Regex::build(const std::vector<Node> &tree, int node, Frag &frag, std::string &error) {
+    if (nfa_.size() > MAX_NFA_STATES) {
+        error = "Regular expression too big";
+        return false;
+    }
+    const Node &n = tree[node];
+    switch (n.kind) {
+    case Node::Empty: {
+        int e = add_state(NState::Nop);
+        frag = Frag{e, e};
+        return true;
+    }
+    case Node::Set:
+    case Node::Begin:
+    case Node::End: {
+        int s;
+        if (n.kind == Node::Set) {
+            sets_.push_back(n.set);
+            s = add_state(NState::Byte, static_cast<int>(sets_.size() - 1));
+        } else {
+            s = add_state((n.kind == Node::Begin) != reversed_ ? NState::Begin : NState::End);
+        }
+        int e = add_state(NState::Nop);
+        nfa_[s].out = e;
+        frag = Frag{s, e};
+        return true;
+    }
+    case Node::Concat: {
+        size_t count = n.kids.size();
+        auto kid = [&](size_t k) { return n.kids[reversed_ ? count - 1 - k : k]; };
+        Frag first;
+        if (!build(tree, kid(0), first, error)) return false;
+        frag = first;
+        for (size_t k = 1; k < count; ++k) {
+            Frag next;
+            if (!build(tree, kid(k), next, error)) return false;
+            nfa_[frag.end].out = next.start;
+            frag.end = next.end;
+        }
+        return true;
+    }
+    case Node::Alt: {
+        int e = add_state(NState::Nop);
+        int entry = -1, prev_split = -1;
+        for (size_t k = 0; k < n.kids.size(); ++k) {
+            Frag branch;
+            if (!build(tree, n.kids[k], branch, error)) return false;
+            nfa_[branch.end].out = e;
+            int split = add_state(NState::Nop);
+            nfa_[split].out = branch.start;
+            if (prev_split < 0) {
+                entry = split;
+            } else {
+                nfa_[prev_split].out1 = split;
+            }
+            prev_split = split;
+        }
+        frag = Frag{entry, e};
+        return true;
+    }
+    case Node::Repeat: {
+        int entry = add_state(NState::Nop);
+        frag = Frag{entry, entry};
+        for (int k = 0; k < n.min; ++k) { // mandatory copies
+            Frag copy;
+            if (!build(tree, n.kids[0], copy, error)) return false;
+            nfa_[frag.end].out = copy.start;
+            frag.end = copy.end;
+        }
+        if (n.max < 0) { // loop: split -> body -> split, or leave
+            Frag body;
+            if (!build(tree, n.kids[0], body, error)) return false;
+            int split = add_state(NState::Nop);
+            int exit = add_state(NState::Nop);
+            nfa_[frag.end].out = split;
+            nfa_[split].out = body.start;
+            nfa_[split].out1 = exit;
+            nfa_[body.end].out = split;
+            frag.end = exit;
+        } else if (n.max > n.min) { // optional copies, each one may end the repetition
+            int exit = add_state(NState::Nop);
+            for (int k = n.min; k < n.max; ++k) {
+                Frag copy;
+                if (!build(tree, n.kids[0], copy, error)) return false;
+                int split = add_state(NState::Nop);
+                nfa_[frag.end].out = split;
+                nfa_[split].out = copy.start;
+                nfa_[split].out1 = exit;
+                frag.end = copy.end;
+            }
+            nfa_[frag.end].out = exit;
+            frag.end = exit;
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+// Partition the bytes into classes that no byte set of the NFA tells apart;
+// '\n' always gets a class of its own (it separates lines).
+inline void Regex::make_classes() {
+    std::vector<int> cls(256, 0);
+    cls['\n'] = 1;
+    int count = 2;
+    for (const ByteSet &set : sets_) {
+        std::vector<int> split(static_cast<size_t>(count) * 2, -1);
+        int next = 0;
+        for (unsigned c = 0; c < 256; ++c) {
+            int &target = split[static_cast<size_t>(cls[c]) * 2 + (set.has(c) ? 1 : 0)];
+            if (target < 0) target = next++;
+            cls[c] = target;
+        }
+        count = next;
+    }
+    for (unsigned c = 0; c < 256; ++c) classes_[c] = static_cast<uint8_t>(cls[c]);
+    num_classes_ = static_cast<size_t>(count);
+}
+
+inline void Regex::better(std::vector<std::string> &best, const std::vector<std::string> &cand) {
+    auto score = [](const std::vector<std::string> &v) {
+        if (v.empty()) return size_t(0);
+        size_t shortest = npos;
+        for (const std::string &s : v) shortest = std::min(shortest, s.size());
+        if (shortest == 0) return size_t(0);
+        return shortest * 4 + (v.size() == 1 ? 2 : 0); // longer literals first, then fewer
+    };
+    if (score(cand) > score(best)) best = cand;
+}
+
+inline Regex::Literals Regex::literals(const std::vector<Node> &tree, int node) const {
+    const size_t MAX_SET = 64;  // strings in an exact or required set
+    const size_t MAX_LEN = 64;  // bytes per exact string
+
+    const Node &n = tree[node];
+    Literals out;
+    switch (n.kind) {
+    case Node::Empty:
+    case Node::Begin:
+    case Node::End:
+        out.exact_known = true;
+        out.exact.push_back(std::string());
+        break;
+    case Node::Set: {
+        // a few bytes (with -i a letter and its capital count once: the prefilter folds too)
+        std::vector<std::string> bytes;
+        for (unsigned c = 0; c < 256 && bytes.size() <= 8; ++c) {
+            if (!n.set.has(c)) continue;
+            if (icase_ && c >= 'A' && c <= 'Z' && n.set.has(c | 0x20)) continue;
+            bytes.push_back(std::string(1, static_cast<char>(c)));
+        }
+        if (!bytes.empty() && bytes.size() <= 8) {
+            out.exact_known = true;
+            out.exact = bytes;
+        }
+        break;
+    }
+    case Node::Concat: {
+        // join the exact sets of neighbouring kids while the cross product
+        // stays small; every run that ends is a candidate
+        std::vector<std::string> run(1, std::string());
+        bool all_exact = true;
+        auto dedup = [](std::vector<std::string> &v) {
+            std::sort(v.begin(), v.end());
+            v.erase(std::unique(v.begin(), v.end()), v.end());
+        };
+        for (int kid : n.kids) {
+            Literals k = literals(tree, kid);
+            if (!k.repeat.empty()) {
+                all_exact = false;
+                std::vector<std::string> first;
+                if (run.size() * k.repeat.size() <= MAX_SET) {
+                    for (const std::string &a : run) {
+                        for (const std::string &b : k.repeat) first.push_back(a + b);
+                    }
+                }
+                dedup(first);
+                better(out.req, first);
+                better(out.req, k.req);
+                run = k.repeat;
+                continue;
+            }
+            if (k.exact_known && run.size() * k.exact.size() <= MAX_SET) {
+                std::vector<std::string> product;
+                bool too_long = false;
+                for (const std::string &a : run) {
+                    for (const std::string &b : k.exact) {
+                        product.push_back(a + b);
+                        too_long = too_long || product.back().size() > MAX_LEN;
+                    }
+                }
+                if (!too_long) {
+                    run.swap(product);
+                    continue;
+                }
+            }
+            all_exact = false;
+            dedup(run);
+            better(out.req, run);
+            if (k.exact_known) {
+                run = k.exact; // a new run starts with this kid
+            } else {
+                better(out.req, k.req);
+                run.assign(1, std::string());
+            }
+        }
+        dedup(run);
+        if (all_exact) {
+            out.exact_known = true;
+            out.exact = run;
+        } else {
+            better(out.req, run);
+        }
+        break;
+    }
+    case Node::Alt: {
+        bool all_exact = true;
+        bool all_req = true;
+        std::vector<std::string> exact, req;
+        for (int kid : n.kids) {
+            Literals k = literals(tree, kid);
+            all_exact = all_exact && k.exact_known;
+            if (k.exact_known) exact.insert(exact.end(), k.exact.begin(), k.exact.end());
+            const std::vector<std::string> &r = k.exact_known ? k.exact : k.req;
+            if (r.empty()) all_req = false;
+            req.insert(req.end(), r.begin(), r.end());
+        }
+        std::sort(exact.begin(), exact.end());
+        exact.erase(std::unique(exact.begin(), exact.end()), exact.end());
+        std::sort(req.begin(), req.end());
+        req.erase(std::unique(req.begin(), req.end()), req.end());
+        if (all_exact && exact.size() <= MAX_SET) {
+            out.exact_known = true;
+            out.exact = exact;
+        }
+        if (all_req && req.size() <= MAX_SET) out.req = req;
+        break;
+    }
+    case Node::Repeat: {
+        Literals k = literals(tree, n.kids[0]);
+        if (n.min == 1 && n.max == 1) return k;
+        if (n.min >= 1) {
+            out.req = k.exact_known ? k.exact : k.req;
+            if (k.exact_known) out.repeat = k.exact;
+        }
+        break;
+    }
+    }
+
+    if (out.exact_known) {
+        // an exact set is also required (unless it allows the empty string)
+        bool has_empty = false;
+        for (const std::string &s : out.exact) has_empty = has_empty || s.empty();
+        if (!has_empty) better(out.req, out.exact);
+    }
+    for (const std::string &s : out.req) {
+        if (s.empty()) {
+            out.req.clear();
+            break;
+        }
+    }
+    return out;
+}
+
+// Follow epsilon moves from the states in set, in place. Begin/End are
+// crossed only at a line start/end; otherwise End states are kept (they may
+// still be crossed when the line ends) and Begin states dropped.
+inline void Regex::closure(std::vector<int> &set, bool at_line_begin, bool at_line_end) const {
+    if (++generation_ == 0) {
+        std::fill(mark_.begin(), mark_.end(), 0);
+        generation_ = 1;
+    }
+    stack_.assign(set.rbegin(), set.rend());
+    set.clear();
+    while (!stack_.empty()) {
+        int s = stack_.back();
+        stack_.pop_back();
+        if (s < 0 || mark_[s] == generation_) continue;
+        mark_[s] = generation_;
+
+        const NState &st = nfa_[s];
+        switch (st.kind) {
+        case NState::Nop:
+            stack_.push_back(st.out1);
+            stack_.push_back(st.out);
+            break;
+        case NState::Begin:
+            if (at_line_begin) stack_.push_back(st.out);
+            break;
+        case NState::End:
+            if (at_line_end) {
+                stack_.push_back(st.out);
+            } else {
+                set.push_back(s);
+            }
+            break;
+        case NState::Byte:
+        case NState::Match:
+            set.push_back(s);
+            break;
+        }
+    }
+}
+
+inline bool Regex::set_matches(const std::vector<int> &set, bool at_line_end) const {
+    std::vector<int> tmp = set;
+    if (at_line_end) closure(tmp, false, true);
+    for (int s : tmp) {
+        if (nfa_[s].kind == NState::Match) return true;
+    }
+    return false;
+}
+
+inline void Regex::Dfa::flush() {
+    stride_ = re_->num_classes_;
+    table_.clear();
+    flags_.clear();
+    sets_.clear();
+    ids_.clear();
+    start_[0] = start_[1] = UNKNOWN;
+    ++flushes_;
+}
+
+inline uint32_t Regex::Dfa::intern(std::vector<int> &set) {
+    std::sort(set.begin(), set.end());
+    std::string key(reinterpret_cast<const char*>(set.data()), set.size() * sizeof(int));
+    auto it = ids_.find(key);
+    if (it != ids_.end()) return it->second;
+
+    if (sets_.size() >= MAX_STATES) flush(); // callers hold no other state ids across this
+
+    uint32_t id = static_cast<uint32_t>(sets_.size() * stride_);
+    uint8_t flags = 0;
+    if (re_->set_matches(set, false)) flags |= F_MATCH;
+    if (re_->set_matches(set, true)) flags |= F_EOL_MATCH;
+    if (set.empty()) flags |= F_DEAD;
+    sets_.push_back(set);
+    flags_.push_back(flags);
+    table_.resize(table_.size() + stride_, UNKNOWN);
+    ids_.emplace(std::move(key), id);
+    return id;
+}
+
+inline uint32_t Regex::Dfa::start(bool at_line_begin) {
+    int k = at_line_begin ? 1 : 0;
+    if (start_[k] == UNKNOWN) {
+        std::vector<int> set(1, re_->start_state_);
+        re_->closure(set, at_line_begin, false);
+        start_[k] = intern(set); // after a flush inside intern
+    }
+    return start_[k];
+}
+
+// Build the transition from s on byte c. For '\n' in an unanchored DFA the
+// MATCH flag means the line that just ended matched at its end, or that the
+// next line matches right at its start.
+inline uint32_t Regex::Dfa::build(uint32_t s, unsigned char c) {
+    std::vector<int> next;
+    bool eol_match = false;
+
+    if (c == '\n') {
+        if (unanchored_) {
+            eol_match = (flags_[s / stride_] & F_EOL_MATCH) || re_->empty_at_begin_;
+            next.push_back(re_->start_state_);
+            re_->closure(next, true, false);
+        }
+    } else {
+        for (int k : sets_[s / stride_]) {
+            const NState &st = re_->nfa_[k];
+            if (st.kind == NState::Byte && re_->sets_[st.set].has(c)) next.push_back(st.out);
+        }
+        if (unanchored_) next.push_back(re_->start_state_);
+        re_->closure(next, false, false);
+    }
+
+    size_t flushes = flushes_;
+    uint32_t id = intern(next);
+    bool match = (c == '\n') ? eol_match : (flags_[id / stride_] & F_MATCH) != 0;
+    uint32_t v = id | (match ? MATCH : 0);
+    if (flushes == flushes_) table_[s + re_->classes_[c]] = v; // else s is gone with the old cache
+    return v;
+}
+
+// End of the first match in hay[from, n), or npos. A '\n' ending the buffer
+// ends its last line; no empty line follows it.
+inline size_t Regex::scan(const char *hay, size_t n, size_t from) const {
+    if (!empty_line_) return scan_dfa(hay, n, from);
+
+    // DFA states forget whether they sit at a line start, so empty lines,
+    // where both anchors hold at once, are looked for separately (only up to
+    // the first DFA match, to stay linear)
+    bool begin = from == 0 || hay[from - 1] == '\n';
+    if (begin && (from < n ? hay[from] == '\n' : n == 0)) return from;
+    size_t end = scan_dfa(hay, n, from);
+    size_t limit = end == npos ? n : std::min(n, end + 1);
+    if (limit - from >= 2) {
+        const void *p = memmem(hay + from, limit - from, "\n\n", 2);
+        if (p != nullptr) return std::min(end, static_cast<size_t>(static_cast<const char*>(p) - hay) + 1);
+    }
+    return end;
+}
+
+// The DFA part of scan. The '\n' transitions of the search DFA report a match
+// at the end of the line they close.
+inline size_t Regex::scan_dfa(const char *hay, size_t n, size_t from) const {
+    bool begin = from == 0 || hay[from - 1] == '\n';
+    if (from == n && n > 0 && begin) return npos;
+    uint32_t s = search_dfa_.start(begin);
+    if (search_dfa_.matches(s)) return from;
+
+    for (size_t i = from; i < n; ++i) {
+        uint32_t v = search_dfa_.table()[s + classes_[static_cast<unsigned char>(hay[i])]];
+        if (v >= Dfa::UNKNOWN) { // rare: not built yet, or a match
+            if (v == Dfa::UNKNOWN) v = search_dfa_.step(s, static_cast<unsigned char>(hay[i]));
+            if (v & Dfa::MATCH) {
+                if (hay[i] != '\n') return i + 1;
+                if (search_dfa_.matches_at_eol(s)) return i;
+                if (i + 1 < n) return i + 1; // empty match at the next line's start (e.g. "^")
+            }
+        }
+        s = v & ~Dfa::MATCH;
+    }
+    if (n > from && hay[n - 1] == '\n') return npos;
+    return search_dfa_.matches_at_eol(s) ? n : npos;
+}
+
+// Length of the longest match starting at s (which ends at or before
+// line_end), or npos.
+inline size_t Regex::longest_at(const char *hay, size_t line_end, size_t s) const {
+    bool begin = s == 0 || hay[s - 1] == '\n';
+    if (begin && s == line_end && empty_line_) return 0;
+    uint32_t st = anchored_dfa_.start(begin);
+    size_t best = anchored_dfa_.matches(st) ? 0 : npos;
+    size_t i = s;
+    for (; i < line_end; ++i) {
+        uint32_t v = anchored_dfa_.step(st, static_cast<unsigned char>(hay[i]));
+        st = v & ~Dfa::MATCH;
+        if (anchored_dfa_.dead(st)) return best;
+        if (v & Dfa::MATCH) best = i + 1 - s;
+    }
+    if (anchored_dfa_.matches_at_eol(st)) best = line_end - s;
+    return best;
+}
+
+inline size_t Regex::first_end(const char *hay, size_t n, size_t from) const {
+    if (!single_ && !multi_) return scan(hay, n, from);
+
+    // only a line holding a required literal can match
+    size_t pos = from;
+    while (pos <= n) {
+        size_t hit = 0, hit_len = 0;
+        if (single_) {
+            hit = single_->find(hay, n, pos);
+            if (hit == npos) return npos;
+        } else if (!multi_->find(hay, n, pos, hit, hit_len)) {
+            return npos;
+        }
+        const void *nl = memrchr(hay + pos, '\n', hit - pos);
+        size_t line = nl == nullptr ? pos : static_cast<size_t>(static_cast<const char*>(nl) - hay) + 1;
+        nl = std::memchr(hay + hit, '\n', n - hit);
+        size_t line_end = nl == nullptr ? n : static_cast<size_t>(static_cast<const char*>(nl) - hay);
+        size_t end = scan(hay, line_end, line);
+        if (end != npos) return end;
+        pos = line_end + 1;
+    }
+    return npos;
+}
+
+// Furthest end of a match starting in [line, end], where end is where the
+// first match ends. The search DFA starts threads up to end; from there the
+// anchored DFA follows the same NFA states without starting new ones.
+inline size_t Regex::reach(const char *hay, size_t line, size_t line_end, size_t end) const {
+    bool begin = line == 0 || hay[line - 1] == '\n';
+    uint32_t s = search_dfa_.start(begin);
+    for (size_t i = line; i < end; ++i) s = search_dfa_.step(s, static_cast<unsigned char>(hay[i])) & ~Dfa::MATCH;
+    uint32_t st = anchored_dfa_.adopt(search_dfa_, s);
+    size_t best = end;
+    for (size_t i = end; i < line_end; ++i) {
+        uint32_t v = anchored_dfa_.step(st, static_cast<unsigned char>(hay[i]));
+        st = v & ~Dfa::MATCH;
+        if (anchored_dfa_.dead(st)) return best;
+        if (v & Dfa::MATCH) best = i + 1;
+    }
+    if (anchored_dfa_.matches_at_eol(st)) best = line_end;
+    return best;
+}
+
+// Leftmost start of a match in [line, reach], or npos: the reverse search
+// DFA reads from reach back to line and stops in a match state wherever a
+// match starts.
+inline size_t Regex::leftmost_start(const char *hay, size_t line, size_t line_end, size_t reach) const {
+    Dfa &dfa = reverse_->search_dfa_;
+    uint32_t s = dfa.start(reach == line_end);
+    size_t best = dfa.matches(s) ? reach : npos;
+    for (size_t i = reach; i > line; --i) {
+        uint32_t v = dfa.step(s, static_cast<unsigned char>(hay[i - 1]));
+        s = v & ~Dfa::MATCH;
+        if (v & Dfa::MATCH) best = i - 1;
+    }
+    bool begin = line == 0 || hay[line - 1] == '\n';
+    if (begin && dfa.matches_at_eol(s)) best = line;
+    return best;
+}
+
+inline bool Regex::find(const char *hay, size_t n, size_t from, size_t &begin, size_t &len) const {
+    size_t pos = from;
+    while (pos <= n) {
+        size_t end = first_end(hay, n, pos);
+        if (end == npos) return false;
+        const void *nl = memrchr(hay + pos, '\n', end - pos);
+        size_t line = nl == nullptr ? pos : static_cast<size_t>(static_cast<const char*>(nl) - hay) + 1;
+        nl = std::memchr(hay + end, '\n', n - end);
+        size_t line_end = nl == nullptr ? n : static_cast<size_t>(static_cast<const char*>(nl) - hay);
+
+        // the leftmost match starts at or before end, so it ends by the
+        // reach of the matches starting there; searching back from that
+        // reach finds it in time linear in the line
+        size_t s = leftmost_start(hay, line, line_end, reach(hay, line, line_end, end));
+        size_t l = s == npos ? npos : longest_at(hay, line_end, s);
+        if (l != npos) {
+            begin = s;
+            len = l;
+            return true;
+        }
+        pos = line_end + 1; // not reached: scan and longest_at agree
+    }
+    return false;
+}
+
+#endif // MYREGEX_H
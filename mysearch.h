@@ -0,0 +1,379 @@
+#ifndef MYSEARCH_H
+#define MYSEARCH_H
+
+// Literal substring search for the my* tools. The algorithm is picked once
+// from the needle: memchr for single bytes, a SIMD first/last byte candidate
+// filter with a memcmp confirm for short and medium needles, and
+// Boyer-Moore-Horspool for long ones. Header-only like myio.h.
+//
+// With ignore_case, ASCII letters match either case (like comparing through
+// tolower() in the C locale). The haystack is folded inside the kernels, so
+// callers never make lowercased copies.
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "mysimd.h"
+
+// ASCII-only tolower, no locale lookup
+inline unsigned char ascii_fold(unsigned char c) {
+    return static_cast<unsigned char>(c - 'A') < 26 ? static_cast<unsigned char>(c | 0x20) : c;
+}
+
+#if MY_X86
+// Fold the ASCII capitals of 16 bytes to lowercase. Bytes >= 0x80 are negative
+// as signed chars and therefore never inside ['A', 'Z'].
+inline __m128i ascii_fold_sse2(__m128i v) {
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+MY_TARGET_AVX2
+inline __m256i ascii_fold_avx2(__m256i v) {
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+    return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+#endif
+
+// Compare n bytes of hay, folded, with an already lowercase needle.
+inline bool equal_folded(const char *hay, const char *lower, size_t n) {
+    size_t k = 0;
+#if MY_X86
+    for (; k + 16 <= n; k += 16) {
+        __m128i a = ascii_fold_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + k)));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lower + k));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) != 0xFFFF) return false;
+    }
+#endif
+    for (; k < n; ++k) {
+        if (ascii_fold(static_cast<unsigned char>(hay[k])) != static_cast<unsigned char>(lower[k])) return false;
+    }
+    return true;
+}
+
+class LiteralSearcher {
+public:
+    static constexpr size_t npos = std::string::npos;
+
+    // Needles at least this long skip ahead with Horspool's bad-character table
+    static constexpr size_t HORSPOOL_MIN = 32;
+
+    enum class Algorithm { Empty, Memchr, PairFilter, Horspool };
+
+    explicit LiteralSearcher(std::string needle, bool ignore_case = false)
+        : needle_(std::move(needle)), fold_(ignore_case) {
+        size_t m = needle_.size();
+        if (fold_) {
+            bool has_letter = false;
+            for (char &ch : needle_) {
+                ch = static_cast<char>(ascii_fold(static_cast<unsigned char>(ch)));
+                has_letter = has_letter || (ch >= 'a' && ch <= 'z');
+            }
+            fold_ = has_letter; // nothing to fold: search exactly
+        }
+
+        if (m == 0) {
+            algorithm_ = Algorithm::Empty;
+        } else if (m == 1 && !fold_) {
+            algorithm_ = Algorithm::Memchr;
+        } else if (m >= HORSPOOL_MIN) {
+            algorithm_ = Algorithm::Horspool;
+            for (size_t k = 0; k < 256; ++k) shift_[k] = m;
+            for (size_t k = 0; k + 1 < m; ++k) {
+                unsigned char ch = static_cast<unsigned char>(needle_[k]);
+                shift_[ch] = m - 1 - k;
+                if (fold_ && ch >= 'a' && ch <= 'z') shift_[ch - 0x20] = m - 1 - k;
+            }
+        } else {
+            algorithm_ = Algorithm::PairFilter;
+#if MY_X86
+            if (cpu_has_avx2()) {
+                pair_ = fold_ ? pair_avx2<true> : pair_avx2<false>;
+            } else {
+                pair_ = fold_ ? pair_sse2<true> : pair_sse2<false>;
+            }
+#else
+            pair_ = fold_ ? pair_scalar<true> : pair_scalar<false>;
+#endif
+        }
+    }
+
+    // The needle as matched: lowercased when searching with ignore_case
+    const std::string &needle() const { return needle_; }
+    size_t size() const { return needle_.size(); }
+    Algorithm algorithm() const { return algorithm_; }
+
+    const char *algorithm_name() const {
+        switch (algorithm_) {
+        case Algorithm::Empty: return "empty";
+        case Algorithm::Memchr: return "memchr";
+        case Algorithm::PairFilter: return cpu_has_avx2() ? "pair-filter/avx2" : "pair-filter";
+        case Algorithm::Horspool: return "horspool";
+        }
+        return "";
+    }
+
+    // Position of the first occurrence at or after from, or npos
+    // (same contract as std::string::find).
+    size_t find(const char *hay, size_t n, size_t from = 0) const {
+        size_t m = needle_.size();
+        if (from > n || m > n - from) return (m == 0 && from <= n) ? from : npos;
+
+        switch (algorithm_) {
+        case Algorithm::Empty:
+            return from;
+        case Algorithm::Memchr: {
+            const void *p = std::memchr(hay + from, needle_[0], n - from);
+            return p == nullptr ? npos : static_cast<size_t>(static_cast<const char*>(p) - hay);
+        }
+        case Algorithm::PairFilter:
+            return pair_(hay, n, from, needle_.data(), m);
+        case Algorithm::Horspool:
+            return fold_ ? horspool<true>(hay, n, from) : horspool<false>(hay, n, from);
+        }
+        return npos;
+    }
+
+    size_t find(const std::string &hay, size_t from = 0) const { return find(hay.data(), hay.size(), from); }
+
+private:
+    typedef size_t (*PairKernel)(const char *, size_t, size_t, const char *, size_t);
+
+    // Confirm a candidate whose first and last bytes already matched
+    template <bool Fold>
+    static bool confirm(const char *hay, const char *needle, size_t m) {
+        if (m <= 2) return true;
+        return Fold ? equal_folded(hay + 1, needle + 1, m - 2) : std::memcmp(hay + 1, needle + 1, m - 2) == 0;
+    }
+
+    // Jump between occurrences of the first byte with memchr (byte by byte
+    // when it is a letter to fold); used for the tails of the SIMD loops.
+    template <bool Fold>
+    static size_t pair_scalar(const char *hay, size_t n, size_t from, const char *needle, size_t m) {
+        unsigned char first = static_cast<unsigned char>(needle[0]);
+        unsigned char last = static_cast<unsigned char>(needle[m - 1]);
+        bool scan = !Fold || !(first >= 'a' && first <= 'z');
+
+        for (size_t i = from; i + m <= n; ++i) {
+            if (scan) {
+                const void *p = std::memchr(hay + i, first, n - m + 1 - i);
+                if (p == nullptr) break;
+                i = static_cast<size_t>(static_cast<const char*>(p) - hay);
+            } else if (ascii_fold(static_cast<unsigned char>(hay[i])) != first) {
+                continue;
+            }
+            unsigned char end = static_cast<unsigned char>(hay[i + m - 1]);
+            if ((Fold ? ascii_fold(end) : end) == last && confirm<Fold>(hay + i, needle, m)) return i;
+        }
+        return npos;
+    }
+
+#if MY_X86
+    // Compare 16 candidate positions at once against the needle's first and
+    // last byte; only positions where both agree go to memcmp. This stays fast
+    // when the first byte alone is common (spaces, '2' in timestamps, ...).
+    template <bool Fold>
+    static size_t pair_sse2(const char *hay, size_t n, size_t from, const char *needle, size_t m) {
+        const __m128i first = _mm_set1_epi8(needle[0]);
+        const __m128i last = _mm_set1_epi8(needle[m - 1]);
+
+        size_t i = from;
+        for (; i + m - 1 + 16 <= n; i += 16) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i + m - 1));
+            if (Fold) {
+                a = ascii_fold_sse2(a);
+                b = ascii_fold_sse2(b);
+            }
+            unsigned mask = static_cast<unsigned>(
+                _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+            for (; mask != 0; mask &= mask - 1) {
+                size_t pos = i + static_cast<size_t>(__builtin_ctz(mask));
+                if (confirm<Fold>(hay + pos, needle, m)) return pos;
+            }
+        }
+        return pair_scalar<Fold>(hay, n, i, needle, m);
+    }
+
+    template <bool Fold>
+    MY_TARGET_AVX2
+    static size_t pair_avx2(const char *hay, size_t n, size_t from, const char *needle, size_t m) {
+        const __m256i first = _mm256_set1_epi8(needle[0]);
+        const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+
+        size_t i = from;
+        for (; i + m - 1 + 32 <= n; i += 32) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay + i + m - 1));
+            if (Fold) {
+                a = ascii_fold_avx2(a);
+                b = ascii_fold_avx2(b);
+            }
+            unsigned mask = static_cast<unsigned>(
+                _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+            for (; mask != 0; mask &= mask - 1) {
+                size_t pos = i + static_cast<size_t>(__builtin_ctz(mask));
+                if (confirm<Fold>(hay + pos, needle, m)) {
+                    _mm256_zeroupper();
+                    return pos;
+                }
+            }
+        }
+        _mm256_zeroupper(); // avoid AVX/SSE transition stalls in the callers
+        return pair_sse2<Fold>(hay, n, i, needle, m); // short lines mostly end up here
+    }
+#endif
+
+    // Boyer-Moore-Horspool: on a mismatch, shift by how far the byte under the
+    // needle's last position is from the end of the needle.
+    template <bool Fold>
+    size_t horspool(const char *hay, size_t n, size_t from) const {
+        size_t m = needle_.size();
+        const char *needle = needle_.data();
+        unsigned char last = static_cast<unsigned char>(needle[m - 1]);
+        for (size_t i = from; i + m <= n;) {
+            unsigned char c = static_cast<unsigned char>(hay[i + m - 1]);
+            if ((Fold ? ascii_fold(c) : c) == last &&
+                (Fold ? equal_folded(hay + i, needle, m - 1) : std::memcmp(hay + i, needle, m - 1) == 0)) {
+                return i;
+            }
+            i += shift_[c];
+        }
+        return npos;
+    }
+
+    std::string needle_;
+    bool fold_ = false;
+    Algorithm algorithm_ = Algorithm::Empty;
+    PairKernel pair_ = nullptr;
+    size_t shift_[256] = {};
+};
+
+// Aho-Corasick automaton for many literals at once (grep -e/-f). The goto and
+// failure links are resolved into a complete DFA over byte classes at build
+// time, so the scan is one table load per input byte. Bytes that occur in no
+// pattern share class 0; with ignore_case a capital shares its lowercase
+// letter's class, so case folding costs nothing while scanning.
+class AhoCorasick {
+public:
+    AhoCorasick(const std::vector<std::string> &patterns, bool ignore_case) {
+        // byte classes
+        std::memset(classes_, 0, sizeof(classes_));
+        num_classes_ = 1;
+        for (const std::string &p : patterns) {
+            for (char ch : p) {
+                unsigned char c = ignore_case ? ascii_fold(static_cast<unsigned char>(ch))
+                                              : static_cast<unsigned char>(ch);
+                if (classes_[c] == 0) classes_[c] = static_cast<uint8_t>(num_classes_++);
+            }
+        }
+        if (ignore_case) {
+            for (unsigned c = 'A'; c <= 'Z'; ++c) classes_[c] = classes_[c | 0x20];
+        }
+        const size_t C = num_classes_;
+
+        // trie: next[s * C + c], 0 = no edge (the root is never a target)
+        std::vector<uint32_t> next(C, 0);
+        std::vector<uint32_t> depth_out(1, 0); // longest pattern ending in the state
+        for (const std::string &p : patterns) {
+            if (p.empty()) continue;
+            uint32_t s = 0;
+            for (char ch : p) {
+                uint32_t &edge = next[s * C + classes_[static_cast<unsigned char>(ch)]];
+                if (edge == 0) {
+                    edge = static_cast<uint32_t>(depth_out.size());
+                    depth_out.push_back(0);
+                    next.resize(next.size() + C, 0);
+                }
+                s = next[s * C + classes_[static_cast<unsigned char>(ch)]]; // next may have moved
+            }
+            depth_out[s] = static_cast<uint32_t>(p.size());
+            if (p.size() > max_len_) max_len_ = p.size();
+        }
+        size_t states = depth_out.size();
+
+        // breadth-first: failure links, inherited outputs, missing edges
+        std::vector<uint32_t> fail(states, 0);
+        std::vector<uint32_t> order;
+        order.reserve(states);
+        order.push_back(0);
+        for (size_t k = 0; k < order.size(); ++k) {
+            uint32_t s = order[k];
+            for (size_t c = 0; c < C; ++c) {
+                uint32_t t = next[s * C + c];
+                if (t != 0) { // a trie edge
+                    fail[t] = (s == 0) ? 0 : next[fail[s] * C + c];
+                    if (depth_out[fail[t]] > depth_out[t]) depth_out[t] = depth_out[fail[t]];
+                    order.push_back(t);
+                } else {
+                    next[s * C + c] = (s == 0) ? 0 : next[fail[s] * C + c];
+                }
+            }
+        }
+
+        // renumber so that every state with an output comes last: the scan
+        // then needs a single compare per byte to notice a match
+        std::vector<uint32_t> index(states);
+        uint32_t k = 0;
+        for (size_t s = 0; s < states; ++s) {
+            if (depth_out[s] == 0) index[s] = k++;
+        }
+        first_match_ = k;
+        for (size_t s = 0; s < states; ++s) {
+            if (depth_out[s] != 0) index[s] = k++;
+        }
+
+        delta_.resize(states * C);
+        out_len_.resize(states - first_match_);
+        for (size_t s = 0; s < states; ++s) {
+            for (size_t c = 0; c < C; ++c) {
+                delta_[index[s] * C + c] = static_cast<uint32_t>(index[next[s * C + c]] * C); // premultiplied
+            }
+            if (depth_out[s] != 0) out_len_[index[s] - first_match_] = depth_out[s];
+        }
+        match_base_ = static_cast<uint32_t>(first_match_ * C);
+    }
+
+    size_t states() const { return delta_.size() / num_classes_; }
+
+    // Leftmost match at or after from, taking the longest one at that position
+    // (what grep -o reports). Returns false if there is none.
+    bool find(const char *hay, size_t n, size_t from, size_t &begin, size_t &len) const {
+        if (max_len_ == 0) return false;
+        const uint32_t *delta = delta_.data();
+        uint32_t s = 0;
+        bool found = false;
+        size_t limit = n;
+
+        for (size_t i = from; i < limit; ++i) {
+            s = delta[s + classes_[static_cast<unsigned char>(hay[i])]];
+            if (s < match_base_) continue;
+
+            size_t l = out_len_[s / num_classes_ - first_match_];
+            size_t b = i + 1 - l;
+            if (!found || b < begin || (b == begin && l > len)) {
+                begin = b;
+                len = l;
+                found = true;
+                // nothing starting after begin can win any more
+                if (begin + max_len_ < limit) limit = begin + max_len_;
+            }
+        }
+        return found;
+    }
+
+private:
+    uint8_t classes_[256];
+    size_t num_classes_ = 1;
+    std::vector<uint32_t> delta_;   // [state * classes + class] -> next state * classes
+    std::vector<uint32_t> out_len_; // per matching state: longest pattern ending there
+    size_t first_match_ = 0;        // matching states are numbered from here on
+    uint32_t match_base_ = 0;       // first_match_ * classes
+    size_t max_len_ = 0;
+};
+
+#endif // MYSEARCH_H
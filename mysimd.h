@@ -0,0 +1,23 @@
+#ifndef MYSIMD_H
+#define MYSIMD_H
+
+// CPU feature detection shared by the vectorized kernels of the my* tools.
+// Kernels are built for the baseline target (SSE2 on x86-64) plus AVX2 variants
+// compiled with MY_TARGET_AVX2 and picked at runtime, so bin/compile needs no -march.
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MY_X86 1
+#include <immintrin.h>
+#define MY_TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+
+inline bool cpu_has_avx2() {
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+#else
+#define MY_X86 0
+
+inline bool cpu_has_avx2() { return false; }
+#endif
+
+#endif // MYSIMD_H
@@ -0,0 +1,205 @@
+#ifndef MYURING_H
+#define MYURING_H
+
+// Minimal io_uring wrapper on the raw syscalls (no liburing needed), enough to
+// batch opens, stats, reads and closes. Header-only like myio.h.
+
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h> // struct statx
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+class IoUring {
+public:
+    IoUring() = default;
+    ~IoUring() { release(); }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Set up a ring with room for entries submissions.
+    // Returns false when io_uring is unavailable (old kernel, seccomp, ...).
+    bool init(unsigned entries) {
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+        struct io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+        if (fd < 0) return false;
+        ring_fd_ = fd;
+
+        sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+        cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) {
+            if (cq_ring_size_ > sq_ring_size_) sq_ring_size_ = cq_ring_size_;
+            cq_ring_size_ = sq_ring_size_;
+        }
+
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) { sq_ring_ = nullptr; release(); return false; }
+
+        if (single) {
+            cq_ring_ = sq_ring_;
+        } else {
+            cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED) { cq_ring_ = nullptr; release(); return false; }
+        }
+
+        sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+        void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) { release(); return false; }
+        sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+        char *sq = static_cast<char*>(sq_ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_entries_ = p.sq_entries;
+        sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+        char *cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+
+        local_tail_ = *sq_tail_;
+        return true;
+#else
+        (void)entries;
+        return false;
+#endif
+    }
+
+    bool ready() const { return ring_fd_ >= 0; }
+    unsigned capacity() const { return sq_entries_; }
+
+    void prep_openat(const char *path, int flags, uint64_t user_data) {
+        struct io_uring_sqe *sqe = next_sqe();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(path);
+        sqe->open_flags = static_cast<uint32_t>(flags);
+        sqe->user_data = user_data;
+    }
+
+    void prep_statx(const char *path, unsigned mask, struct statx *buf, uint64_t user_data) {
+        struct io_uring_sqe *sqe = next_sqe();
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(path);
+        sqe->len = mask;
+        sqe->off = reinterpret_cast<uint64_t>(buf);
+        sqe->user_data = user_data;
+    }
+
+    void prep_read(int fd, void *buf, unsigned len, uint64_t offset, uint64_t user_data) {
+        struct io_uring_sqe *sqe = next_sqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buf);
+        sqe->len = len;
+        sqe->off = offset;
+        sqe->user_data = user_data;
+    }
+
+    void prep_close(int fd, uint64_t user_data) {
+        struct io_uring_sqe *sqe = next_sqe();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fd;
+        sqe->user_data = user_data;
+    }
+
+    // Number of queued but not yet submitted entries
+    unsigned queued() const { return local_tail_ - *sq_tail_; }
+
+    // Submit everything queued and wait for at least wait_nr completions.
+    // Re-enters until the kernel has consumed every entry (it may take fewer
+    // than asked). Returns the number submitted or -errno.
+    int submit(unsigned wait_nr) {
+        __atomic_store_n(sq_tail_, local_tail_, __ATOMIC_RELEASE);
+        unsigned submitted = 0;
+        while (true) {
+            unsigned left = local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+            long r = syscall(__NR_io_uring_enter, ring_fd_, left, wait_nr,
+                             wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                return -errno;
+            }
+            submitted += static_cast<unsigned>(r);
+            if (static_cast<unsigned>(r) >= left) return static_cast<int>(submitted);
+            if (r == 0) return -EAGAIN; // nothing taken: don't spin
+        }
+    }
+
+    // Pop one completion if available
+    bool pop(uint64_t &user_data, int &res) {
+        unsigned head = *cq_head_;
+        if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) return false;
+        const struct io_uring_cqe &cqe = cqes_[head & cq_mask_];
+        user_data = cqe.user_data;
+        res = cqe.res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // Block until a completion is available, then pop it.
+    bool wait(uint64_t &user_data, int &res) {
+        while (!pop(user_data, res)) {
+            if (submit(1) < 0) return false;
+        }
+        return true;
+    }
+
+private:
+    // Callers keep queued() below capacity(); the entry comes back zeroed.
+    struct io_uring_sqe *next_sqe() {
+        unsigned idx = local_tail_ & sq_mask_;
+        struct io_uring_sqe *sqe = &sqes_[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array_[idx] = idx;
+        ++local_tail_;
+        return sqe;
+    }
+
+    void release() {
+        if (sqes_ != nullptr) munmap(sqes_, sqes_size_);
+        if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_ != nullptr) munmap(sq_ring_, sq_ring_size_);
+        if (ring_fd_ >= 0) close(ring_fd_);
+        sqes_ = nullptr;
+        sq_ring_ = cq_ring_ = nullptr;
+        ring_fd_ = -1;
+    }
+
+    int ring_fd_ = -1;
+    void *sq_ring_ = nullptr;
+    void *cq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+    struct io_uring_sqe *sqes_ = nullptr;
+
+    unsigned *sq_head_ = nullptr;
+    unsigned *sq_tail_ = nullptr;
+    unsigned *sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned local_tail_ = 0;
+
+    unsigned *cq_head_ = nullptr;
+    unsigned *cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    struct io_uring_cqe *cqes_ = nullptr;
+};
+
+#endif // MYURING_H
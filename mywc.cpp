@@ -2,20 +2,113 @@
 #include <string>
 #include <unordered_map>
 #include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
 #include <fstream>
 #include <sstream>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "myio.h"
+#include "mysimd.h"
 
-using std::cin;
 using std::cout;
 using std::cerr;
 using std::string;
 using std::unordered_map;
 using std::vector;
-using std::ifstream;
-using std::istringstream;
-using std::ostream;
 
-ostream &process(std::istream &in, unordered_map<string, bool> &options);
+// Counting state for one input. Blocks can be fed in any size: a word or a
+// line that straddles two blocks is carried over in in_word / cur_line.
+struct Counts {
+    size_t lines = 0;     // '\n' bytes seen
+    size_t words = 0;
+    size_t bytes = 0;
+    size_t chars = 0;     // UTF-8 characters: bytes that are not 10xxxxxx continuations
+    size_t max_line = 0;  // longest finished line (only tracked for -L)
+    size_t cur_line = 0;  // bytes since the last '\n'
+    bool in_word = false; // last byte seen belongs to a word
+};
+
+// Counts of one byte range of a file (-j): head is the number of bytes before
+// the range's first '\n', i.e. the tail of a line that began in an earlier range.
+struct ChunkCounts {
+    Counts counts;
+    size_t head = 0;
+    bool ok = true;
+};
+
+// Persistent counts of regular files (--cache), so that a file that only grew
+// since the last run is counted from where that run stopped. Entries are keyed
+// by (device, inode); size and mtime tell whether the file is unchanged, and a
+// hash of the bytes around the old end tells an append from a rewrite.
+class CountCache {
+public:
+    struct Entry {
+        size_t size = 0;      // bytes covered by counts
+        int64_t mtime_sec = 0;
+        int64_t mtime_nsec = 0;
+        uint64_t fingerprint = 0;
+        bool longest = false; // counts.max_line is valid
+        Counts counts;
+    };
+
+    explicit CountCache(string path) : path_(std::move(path)) {}
+
+    void load();
+    void save();
+    bool find(const struct stat &st, Entry &e);
+    void store(const struct stat &st, const Entry &e);
+
+private:
+    struct Key {
+        uint64_t dev;
+        uint64_t ino;
+        bool operator==(const Key &o) const { return dev == o.dev && ino == o.ino; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key &k) const { return std::hash<uint64_t>()(k.ino * 31 + k.dev); }
+    };
+    struct Slot {
+        Entry entry;
+        bool used = false; // looked up or stored by this run
+    };
+
+    static const size_t MAX_ENTRIES = 4096;
+
+    string path_;
+    std::mutex mu_;
+    unordered_map<Key, Slot, KeyHash> entries_;
+    bool dirty_ = false;
+};
+
+// How to count, resolved once from the command line
+struct CountMode {
+    bool longest = false;    // -L: track the longest line
+    bool bytes_only = false; // -c alone: a regular file's size is enough
+    unsigned jobs = 1;       // -j: threads per large file
+    CountCache *cache = nullptr; // --cache
+};
+
+void count_block(const char *p, size_t n, Counts &c, bool longest);
+bool count_fd(int fd, Counts &c, bool longest);
+bool count_fd_parallel(int fd, size_t size, Counts &c, bool longest, unsigned jobs);
+bool count_file(int fd, Counts &c, const CountMode &mode);
+bool count_cached(int fd, const struct stat &st, Counts &c, const CountMode &mode);
+string default_cache_path();
+void add_counts(Counts &total, const Counts &c);
+OutputWriter &print_counts(const Counts &c, unordered_map<string, bool> &options);
+OutputWriter &process(int fd, unordered_map<string, bool> &options, const CountMode &mode);
+void process_files(const vector<string> &files, unordered_map<string, bool> &options, const CountMode &mode);
 
 int main(int argc, char *argv[]) {
     
@@ -23,12 +116,15 @@ int main(int argc, char *argv[]) {
         {"--help", false}, // Display help information
         {"-l", false}, // Show line counts
         {"-c", false}, // Show byte counts
+        {"-m", false}, // Show character counts
         {"-w", false}, // Show word counts
         {"-L", false} // Show longest line length
     };
 
     // process command-line arguments
     vector<string> files;
+    unsigned jobs = 1; // -j: threads per file
+    string cache_path; // --cache[=FILE]
 
     size_t i = 1;;
     for (i = 1; i < argc; ++i) {
@@ -42,15 +138,40 @@ int main(int argc, char *argv[]) {
                      << "  --help    Display this help information\n"
                      << "  -l        Show line counts\n"
                      << "  -c        Show byte counts\n"
+                     << "  -m        Show character (UTF-8) counts\n"
                      << "  -w        Show word counts\n"
-                     << "  -L        Show longest line length\n";
+                     << "  -L        Show longest line length\n"
+                     << "  -j N      Count each large file with N threads\n"
+                     << "  --cache[=FILE]  Remember counts of regular files and only count\n"
+                     << "                  what was appended since the last run\n";
                 return 0;
+            } else if (arg == "--cache") {
+                cache_path = default_cache_path();
+                if (cache_path.empty()) {
+                    cerr << "Error: No cache location: set HOME or use --cache=FILE" << std::endl;
+                    return 1;
+                }
+            } else if (arg.compare(0, 8, "--cache=") == 0 && arg.size() > 8) {
+                cache_path = arg.substr(8);
             } else {
 
                 for (size_t j = 1; j < arg.size(); ++j) {
                     string opt("-" + string(1, arg[j]));
 
-                    if (options.find(opt) != options.end()) {
+                    if (opt == "-j") { // takes a value: -j4 or -j 4
+                        string value = arg.substr(j + 1);
+                        if (value.empty() && i + 1 < static_cast<size_t>(argc)) {
+                            value = argv[++i];
+                        }
+                        char *end = nullptr;
+                        long n = std::strtol(value.c_str(), &end, 10);
+                        if (value.empty() || *end != '\0' || n < 1 || n > 1024) {
+                            cerr << "Error: Invalid thread count for -j: " << value << std::endl;
+                            return 1;
+                        }
+                        jobs = static_cast<unsigned>(n);
+                        break;
+                    } else if (options.find(opt) != options.end()) {
                         options[opt] = true; // Enable the option
                     } else {
                         cerr << "Warning: Unknown option " << opt << std::endl;
@@ -63,67 +184,535 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    CountMode mode;
+    mode.longest = options["-L"];
+    mode.bytes_only = options["-c"] && !options["-l"] && !options["-w"] && !options["-m"] && !options["-L"];
+    mode.jobs = jobs;
+
+    std::unique_ptr<CountCache> cache;
+    if (!cache_path.empty() && !mode.bytes_only) { // -c alone never reads, nothing to cache
+        cache.reset(new CountCache(cache_path));
+        cache->load();
+        mode.cache = cache.get();
+    }
+
     // process each file
     if (files.empty()) { // no files specified, read from standard input, support pipe input
-        process(cin, options) << std::endl;
-    } else { // files specified
-        for (const auto &filename : files) {
-
-            ifstream infile(filename);
-            if (!infile) {
-                cerr << "Error: Could not open file " << filename << std::endl;
-                continue;
-            }
+        process(STDIN_FILENO, options, mode) << '\n';
+    } else if (files.size() == 1) { // single file
+        int fd = open(files[0].c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            cerr << "Error: Could not open file " << files[0] << std::endl;
+            return 0;
+        }
+
+        process(fd, options, mode) << " " + files[0] << '\n';
+        close(fd);
+    } else { // several files: count them concurrently, print in order plus a total
+        process_files(files, options, mode);
+    }
+
+    if (cache) cache->save();
+}
+
+// Count one input and print its counts (without the trailing file name).
+OutputWriter &process(int fd, unordered_map<string, bool> &options, const CountMode &mode) {
+    Counts c;
+    if (!count_file(fd, c, mode)) {
+        cerr << "Error: Could not read input" << std::endl;
+    }
+    return print_counts(c, options);
+}
+
+// Count one open input. -c alone on a regular file is answered from fstat
+// without reading; large regular files are split across threads when -j asks for it.
+bool count_file(int fd, Counts &c, const CountMode &mode) {
+    const size_t MIN_CHUNK = 4 << 20; // smaller ranges are not worth a thread
+
+    struct stat st;
+    bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    size_t size = regular ? static_cast<size_t>(st.st_size) : 0;
+    // an inherited descriptor (wc -c < file after a read) only has the rest left to count
+    off_t offset = regular ? lseek(fd, 0, SEEK_CUR) : -1;
+
+    if (mode.bytes_only && regular && size > 0 && offset >= 0) { // size 0 may be a /proc-style file: read it
+        c.bytes = size > static_cast<size_t>(offset) ? size - static_cast<size_t>(offset) : 0;
+        return true;
+    }
+    if (mode.cache != nullptr && regular && size > 0 && offset == 0) {
+        return count_cached(fd, st, c, mode);
+    }
+    if (mode.jobs > 1 && regular && size >= 2 * MIN_CHUNK && offset == 0) {
+        unsigned jobs = static_cast<unsigned>(std::min<size_t>(mode.jobs, size / MIN_CHUNK));
+        return count_fd_parallel(fd, size, c, mode.longest, jobs);
+    }
+    return count_fd(fd, c, mode.longest);
+}
+
+// Hash of the first and last (up to) 64 bytes of [0, end): cheap to recheck,
+// and it changes when a file was truncated and rewritten past its old size.
+static bool prefix_fingerprint(int fd, size_t end, uint64_t &hash) {
+    const size_t EDGE = 64;
+    char buf[2 * EDGE];
+    size_t head = std::min(end, EDGE);
+    size_t tail = std::min(end - head, EDGE);
+
+    if (pread(fd, buf, head, 0) != static_cast<ssize_t>(head)) return false;
+    if (tail > 0 && pread(fd, buf + head, tail, static_cast<off_t>(end - tail)) != static_cast<ssize_t>(tail)) {
+        return false;
+    }
+
+    hash = 14695981039346656037ULL; // FNV-1a
+    for (size_t k = 0; k < head + tail; ++k) {
+        hash = (hash ^ static_cast<unsigned char>(buf[k])) * 1099511628211ULL;
+    }
+    hash ^= end;
+    return true;
+}
+
+// Count a regular file through the cache: unchanged files are not read at all,
+// grown files only from the end of the cached prefix.
+bool count_cached(int fd, const struct stat &st, Counts &c, const CountMode &mode) {
+    size_t size = static_cast<size_t>(st.st_size);
+    CountCache::Entry e;
+    size_t offset = 0;
 
-            process(infile, options) << " " + filename << std::endl;
-            infile.close();
+    if (mode.cache->find(st, e) && (e.longest || !mode.longest)) {
+        uint64_t hash;
+        if (e.size == size && e.mtime_sec == st.st_mtim.tv_sec && e.mtime_nsec == st.st_mtim.tv_nsec) {
+            c = e.counts;
+            return true;
         }
+        if (e.size < size && prefix_fingerprint(fd, e.size, hash) && hash == e.fingerprint) {
+            c = e.counts;
+            offset = e.size;
+        }
+    }
+
+    bool ok;
+    if (offset == 0) {
+        CountMode plain = mode;
+        plain.cache = nullptr;
+        ok = count_file(fd, c, plain);
+    } else {
+        ok = lseek(fd, static_cast<off_t>(offset), SEEK_SET) != -1 && count_fd(fd, c, mode.longest);
+    }
+    if (!ok) return false;
+
+    // the file may have grown while it was read: the entry covers what was counted
+    e.size = c.bytes;
+    e.mtime_sec = st.st_mtim.tv_sec;
+    e.mtime_nsec = st.st_mtim.tv_nsec;
+    e.longest = mode.longest;
+    e.counts = c;
+    if (prefix_fingerprint(fd, e.size, e.fingerprint)) {
+        mode.cache->store(st, e);
     }
+    return true;
 }
 
-ostream &process(std::istream &in, unordered_map<string, bool> &options) {
-    size_t line_count = 0;
-    size_t word_count = 0;
-    size_t char_count = 0;
-    size_t max_line_length = 0;
+// $XDG_CACHE_HOME/mywc.cache, else ~/.cache/mywc.cache
+string default_cache_path() {
+    const char *xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg != nullptr && xdg[0] != '\0') return string(xdg) + "/mywc.cache";
+    const char *home = std::getenv("HOME");
+    if (home == nullptr || home[0] == '\0') return string();
+    string dir = string(home) + "/.cache";
+    mkdir(dir.c_str(), 0700); // usually exists already
+    return dir + "/mywc.cache";
+}
 
+// One entry per line: dev ino size mtime_sec mtime_nsec fingerprint longest
+// followed by the Counts fields. A missing or unreadable file is an empty cache.
+void CountCache::load() {
+    std::ifstream in(path_);
     string line;
+    if (!std::getline(in, line) || line != "mywc-cache 1") return;
+
     while (std::getline(in, line)) {
-        ++line_count;
-        char_count += line.size() + 1; // +1 for newline character
+        std::istringstream fields(line);
+        Key key;
+        Slot slot;
+        Entry &e = slot.entry;
+        Counts &c = e.counts;
+        int longest, in_word;
+        if (fields >> key.dev >> key.ino >> e.size >> e.mtime_sec >> e.mtime_nsec >> e.fingerprint >> longest >>
+            c.lines >> c.words >> c.bytes >> c.chars >> c.max_line >> c.cur_line >> in_word) {
+            e.longest = longest != 0;
+            c.in_word = in_word != 0;
+            entries_[key] = slot;
+        }
+    }
+}
+
+// Write the cache to a temporary file and rename it over the old one, so a
+// concurrent or interrupted run never sees a half-written cache.
+void CountCache::save() {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!dirty_) return;
+
+    bool prune = entries_.size() > MAX_ENTRIES; // keep only what this run touched
+    string tmp = path_ + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream os(tmp, std::ios::trunc);
+        os << "mywc-cache 1\n";
+        for (const auto &kv : entries_) {
+            if (prune && !kv.second.used) continue;
+            const Entry &e = kv.second.entry;
+            const Counts &c = e.counts;
+            os << kv.first.dev << ' ' << kv.first.ino << ' ' << e.size << ' ' << e.mtime_sec << ' '
+               << e.mtime_nsec << ' ' << e.fingerprint << ' ' << (e.longest ? 1 : 0) << ' ' << c.lines << ' '
+               << c.words << ' ' << c.bytes << ' ' << c.chars << ' ' << c.max_line << ' ' << c.cur_line << ' '
+               << (c.in_word ? 1 : 0) << '\n';
+        }
+        os.flush();
+        if (!os) {
+            cerr << "Warning: Could not write cache " << path_ << std::endl;
+            unlink(tmp.c_str());
+            return;
+        }
+    }
+    if (rename(tmp.c_str(), path_.c_str()) != 0) {
+        cerr << "Warning: Could not write cache " << path_ << std::endl;
+        unlink(tmp.c_str());
+    }
+}
+
+bool CountCache::find(const struct stat &st, Entry &e) {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = entries_.find(Key{static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)});
+    if (it == entries_.end()) return false;
+    it->second.used = true;
+    e = it->second.entry;
+    return true;
+}
+
+void CountCache::store(const struct stat &st, const Entry &e) {
+    std::lock_guard<std::mutex> lock(mu_);
+    Slot &slot = entries_[Key{static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)}];
+    slot.entry = e;
+    slot.used = true;
+    dirty_ = true;
+}
+
+// Count many files on a pool of worker threads. Results are printed strictly
+// in argument order as soon as each one (and all before it) is done, followed
+// by a total row like GNU wc.
+void process_files(const vector<string> &files, unordered_map<string, bool> &options, const CountMode &mode) {
+    struct FileResult {
+        Counts counts;
+        bool opened = false;
+        bool read_ok = false;
+        bool done = false;
+    };
+
+    vector<FileResult> results(files.size());
+    std::atomic<size_t> next_file{0};
+    std::mutex mu;
+    std::condition_variable cv;
 
-        if (options["-L"] == true) {
-            if (line.size() > max_line_length) {
-                max_line_length = line.size();
+    auto worker = [&]() {
+        size_t k;
+        while ((k = next_file.fetch_add(1)) < files.size()) {
+            FileResult &r = results[k];
+            int fd = open(files[k].c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd != -1) {
+                r.opened = true;
+                r.read_ok = count_file(fd, r.counts, mode);
+                close(fd);
             }
+            {
+                std::lock_guard<std::mutex> lock(mu);
+                r.done = true;
+            }
+            cv.notify_all();
+        }
+    };
+
+    // counting is mostly waiting on I/O: a few more threads than cores help
+    unsigned hw = std::thread::hardware_concurrency();
+    size_t pool_size = std::min<size_t>(files.size(), std::min(16u, std::max(4u, hw)));
+    vector<std::thread> pool;
+    for (size_t t = 0; t < pool_size; ++t) {
+        pool.emplace_back(worker);
+    }
+
+    Counts total;
+    for (size_t k = 0; k < files.size(); ++k) {
+        {
+            std::unique_lock<std::mutex> lock(mu);
+            cv.wait(lock, [&] { return results[k].done; });
+        }
+
+        const FileResult &r = results[k];
+        if (!r.opened) {
+            cerr << "Error: Could not open file " << files[k] << std::endl;
+            continue;
+        }
+        if (!r.read_ok) {
+            cerr << "Error: Could not read file " << files[k] << std::endl;
+        }
+        print_counts(r.counts, options) << " " + files[k] << '\n';
+        add_counts(total, r.counts);
+    }
+    print_counts(total, options) << " total" << '\n';
+
+    for (auto &t : pool) t.join();
+}
+
+// Add the counts of one file, as printed, to a running total.
+void add_counts(Counts &total, const Counts &c) {
+    bool partial = c.cur_line > 0;
+    total.lines += c.lines + (partial ? 1 : 0);
+    total.words += c.words;
+    total.bytes += c.bytes;
+    total.chars += c.chars;
+    total.max_line = std::max({total.max_line, c.max_line, c.cur_line});
+}
+
+bool count_fd(int fd, Counts &c, bool longest) {
+    thread_local vector<char> buf(1 << 18);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    while (true) {
+        ssize_t n = read(fd, buf.data(), buf.size());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) return true;
+        count_block(buf.data(), static_cast<size_t>(n), c, longest);
+    }
+}
+
+// Whitespace is what isspace() accepts in the C locale: ' ' and '\t'..'\r'.
+static inline bool is_space_byte(unsigned char ch) {
+    return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+// Count [begin, end) of fd with pread. The byte before begin decides whether
+// the range starts inside a word, so words crossing the boundary count once.
+static void count_range(int fd, size_t begin, size_t end, bool longest, ChunkCounts &out_chunk) {
+    vector<char> buf(1 << 18);
+    Counts &c = out_chunk.counts;
+    bool head_done = false;
+
+    if (begin > 0) {
+        char prev;
+        if (pread(fd, &prev, 1, static_cast<off_t>(begin - 1)) != 1) {
+            out_chunk.ok = false;
+            return;
+        }
+        c.in_word = !is_space_byte(static_cast<unsigned char>(prev));
+    }
+
+    size_t pos = begin;
+    while (pos < end) {
+        size_t want = std::min(buf.size(), end - pos);
+        ssize_t n = pread(fd, buf.data(), want, static_cast<off_t>(pos));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { // error, or the file shrank underneath us
+            out_chunk.ok = (n == 0);
+            break;
+        }
+
+        if (!head_done) {
+            const void *nl = std::memchr(buf.data(), '\n', static_cast<size_t>(n));
+            if (nl != nullptr) {
+                out_chunk.head += static_cast<size_t>(static_cast<const char*>(nl) - buf.data());
+                head_done = true;
+            } else {
+                out_chunk.head += static_cast<size_t>(n);
+            }
+        }
+        count_block(buf.data(), static_cast<size_t>(n), c, longest);
+        pos += static_cast<size_t>(n);
+    }
+}
+
+// Split a regular file into jobs ranges, count them on separate threads and
+// merge the partial counts in file order. The result equals count_fd's.
+bool count_fd_parallel(int fd, size_t size, Counts &c, bool longest, unsigned jobs) {
+    const size_t ALIGN = 1 << 16;
+    size_t step = (size / jobs + ALIGN - 1) / ALIGN * ALIGN;
+
+    vector<ChunkCounts> chunks(jobs);
+    vector<std::thread> threads;
+    for (unsigned k = 0; k < jobs; ++k) {
+        size_t begin = std::min(size, k * step);
+        size_t end = (k + 1 == jobs) ? size : std::min(size, (k + 1) * step);
+        threads.emplace_back(count_range, fd, begin, end, longest, std::ref(chunks[k]));
+    }
+    for (auto &t : threads) t.join();
+
+    bool ok = true;
+    for (const ChunkCounts &chunk : chunks) {
+        const Counts &part = chunk.counts;
+        ok = ok && chunk.ok;
+
+        c.words += part.words;
+        c.bytes += part.bytes;
+        c.chars += part.chars;
+        if (part.lines > 0) {
+            // the line running into this range ends at its first '\n'
+            c.max_line = std::max({c.max_line, c.cur_line + chunk.head, part.max_line});
+            c.cur_line = part.cur_line;
+        } else {
+            c.cur_line += part.bytes;
+        }
+        c.lines += part.lines;
+        if (part.bytes > 0) c.in_word = part.in_word;
+    }
+    return ok;
+}
+
+static void count_scalar(const char *p, size_t n, Counts &c, bool longest) {
+    for (size_t k = 0; k < n; ++k) {
+        unsigned char ch = static_cast<unsigned char>(p[k]);
+        if (ch == '\n') {
+            ++c.lines;
+            if (longest && c.cur_line > c.max_line) c.max_line = c.cur_line;
+            c.cur_line = 0;
+        } else {
+            ++c.cur_line;
+        }
+        bool space = is_space_byte(ch);
+        if (!space && !c.in_word) ++c.words;
+        c.in_word = !space;
+        if ((ch & 0xC0) != 0x80) ++c.chars;
+    }
+    c.bytes += n;
+}
+
+// Fold the newline / whitespace / UTF-8 lead-byte bitmasks of a 64-byte chunk
+// into the counts. A word starts at every non-space byte whose predecessor is
+// a space; the predecessor of bit 0 is the last byte of the previous chunk.
+static inline void count_masks(uint64_t nl, uint64_t ws, uint64_t lead, Counts &c, bool longest) {
+    uint64_t starts = ~ws & ((ws << 1) | (c.in_word ? 0 : 1));
+    c.words += static_cast<size_t>(__builtin_popcountll(starts));
+    c.chars += static_cast<size_t>(__builtin_popcountll(lead));
+    c.in_word = (ws >> 63) == 0;
+    c.bytes += 64;
+
+    if (nl == 0) {
+        c.cur_line += 64;
+        return;
+    }
+    c.lines += static_cast<size_t>(__builtin_popcountll(nl));
+
+    if (longest) {
+        size_t seg = 0; // start of the current line inside this chunk
+        for (uint64_t m = nl; m != 0; m &= m - 1) {
+            size_t pos = static_cast<size_t>(__builtin_ctzll(m));
+            size_t len = c.cur_line + (pos - seg);
+            if (len > c.max_line) c.max_line = len;
+            c.cur_line = 0;
+            seg = pos + 1;
         }
+    }
+    c.cur_line = static_cast<size_t>(__builtin_clzll(nl)); // bytes after the last '\n'
+}
 
-        istringstream iss(line);
-        string word;
-        while (iss >> word) {
-            ++word_count;
+#if MY_X86
+static void count_sse2(const char *p, size_t n, Counts &c, bool longest) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i ctl_lo = _mm_set1_epi8('\t' - 1);
+    const __m128i ctl_hi = _mm_set1_epi8('\r' + 1);
+    const __m128i cont_hi = _mm_set1_epi8(static_cast<char>(0xBF)); // signed: 10xxxxxx is <= 0xBF
+
+    size_t k = 0;
+    for (; k + 64 <= n; k += 64) {
+        uint64_t nl = 0, ws = 0, lead = 0;
+        for (int part = 0; part < 4; ++part) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k + 16 * part));
+            __m128i ctl = _mm_and_si128(_mm_cmpgt_epi8(v, ctl_lo), _mm_cmplt_epi8(v, ctl_hi));
+            __m128i sp = _mm_or_si128(ctl, _mm_cmpeq_epi8(v, space));
+            uint64_t nl_bits = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)));
+            uint64_t ws_bits = static_cast<unsigned>(_mm_movemask_epi8(sp));
+            uint64_t lead_bits = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpgt_epi8(v, cont_hi)));
+            nl |= nl_bits << (16 * part);
+            ws |= ws_bits << (16 * part);
+            lead |= lead_bits << (16 * part);
         }
+        count_masks(nl, ws, lead, c, longest);
+    }
+    count_scalar(p + k, n - k, c, longest);
+}
+
+MY_TARGET_AVX2
+static void count_avx2(const char *p, size_t n, Counts &c, bool longest) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i ctl_lo = _mm256_set1_epi8('\t' - 1);
+    const __m256i ctl_hi = _mm256_set1_epi8('\r' + 1);
+    const __m256i cont_hi = _mm256_set1_epi8(static_cast<char>(0xBF));
+
+    size_t k = 0;
+    for (; k + 64 <= n; k += 64) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + k));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + k + 32));
+
+        __m256i ws_a = _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi8(a, ctl_lo), _mm256_cmpgt_epi8(ctl_hi, a)),
+                                       _mm256_cmpeq_epi8(a, space));
+        __m256i ws_b = _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi8(b, ctl_lo), _mm256_cmpgt_epi8(ctl_hi, b)),
+                                       _mm256_cmpeq_epi8(b, space));
+
+        uint64_t nl_a = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, newline)));
+        uint64_t nl_b = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, newline)));
+        uint64_t ws_lo = static_cast<uint32_t>(_mm256_movemask_epi8(ws_a));
+        uint64_t ws_hi = static_cast<uint32_t>(_mm256_movemask_epi8(ws_b));
+        uint64_t lead_lo = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(a, cont_hi)));
+        uint64_t lead_hi = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(b, cont_hi)));
+        count_masks(nl_a | (nl_b << 32), ws_lo | (ws_hi << 32), lead_lo | (lead_hi << 32), c, longest);
     }
+    _mm256_zeroupper(); // avoid AVX/SSE transition stalls in the callers
+    count_scalar(p + k, n - k, c, longest);
+}
+#endif
+
+// Runs the widest kernel the CPU supports (chosen once).
+void count_block(const char *p, size_t n, Counts &c, bool longest) {
+#if MY_X86
+    static void (*const kernel)(const char *, size_t, Counts &, bool) = cpu_has_avx2() ? count_avx2 : count_sse2;
+#else
+    static void (*const kernel)(const char *, size_t, Counts &, bool) = count_scalar;
+#endif
+    kernel(p, n, c, longest);
+}
+
+// Print the counts in the selected format. Like the getline-based counter
+// this replaced, an unterminated last line still counts as a line.
+OutputWriter &print_counts(const Counts &c, unordered_map<string, bool> &options) {
+    bool partial = c.cur_line > 0;
+    size_t line_count = c.lines + (partial ? 1 : 0);
+    size_t word_count = c.words;
+    size_t char_count = c.bytes;
+    size_t max_line_length = std::max(c.max_line, c.cur_line);
 
     if (options["-l"] == true) {
-        cout << "Lines: " << line_count << " ";
+        out() << "Lines: " << line_count << " ";
     }
     if (options["-w"] == true) {
-        cout << "Words: " << word_count << " ";
+        out() << "Words: " << word_count << " ";
+    }
+    if (options["-m"] == true) {
+        out() << "Chars: " << c.chars << " ";
     }
     if (options["-c"] == true) {
-        cout << "Bytes: " << char_count << " ";
+        out() << "Bytes: " << char_count << " ";
     }
     if (options["-L"] == true) {
-        cout << "Max Length: " << max_line_length << " ";
+        out() << "Max Length: " << max_line_length << " ";
     }
 
     // default: show all counts if no specific option is given
-    if (options["-l"] == false && options["-w"] == false && options["-c"] == false && options["-L"] == false) {
-        cout << "Lines: " << line_count << " "
-             << "Words: " << word_count << " "
-             << "Bytes: " << char_count << " ";
+    if (options["-l"] == false && options["-w"] == false && options["-c"] == false &&
+        options["-m"] == false && options["-L"] == false) {
+        out() << "Lines: " << line_count << " "
+              << "Words: " << word_count << " "
+              << "Bytes: " << char_count << " ";
     }
 
-    return cout;
+    return out();
 }
\ No newline at end of file
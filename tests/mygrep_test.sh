@@ -0,0 +1,42 @@
+#!/bin/bash
+# Regression checks for mygrep. Run from the repository root:
+#   tests/mygrep_test.sh
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+g++ mygrep.cpp -o "$dir/mygrep" -std=c++17 -O1 -pthread || exit 1
+
+failed=0
+
+# check NAME WANT GOT
+check() {
+    if [ "$2" != "$3" ]; then
+        printf "FAIL %s\n  want: %q\n  got:  %q\n" "$1" "$2" "$3"
+        failed=1
+    fi
+}
+
+# run ARGS...: mygrep in the scratch directory, killed if it takes too long
+run() {
+    (cd "$dir" && timeout 10 ./mygrep "$@")
+}
+
+# A long line where every 'a' starts a branch that only fails at its end:
+# finding the leftmost match has to stay linear in the line length.
+{ head -c 200000 /dev/zero | tr '\0' a; echo q; } > "$dir/long.txt"
+check "regex -o on a long line" "q" "$(run -o -E 'a[a-z]*Z|q' long.txt)"
+check "regex color on a long line" "$(printf 'aaa\e[31mq\e[0m')" \
+    "$(run --color=always -E 'a[a-z]*Z|q' long.txt | tail -c 14)"
+
+# -o on lines whose only match is empty prints nothing for them, not even
+# the file name
+printf 'abc\nxx\n' > "$dir/f1"
+printf 'q\n' > "$dir/f2"
+check "-o with an empty match" "f1:xx" "$(run -E -o 'x*' f1 f2)"
+check "-o with only empty matches" "" "$(run -E -o '^' f1 f2)"
+
+if [ $failed -eq 0 ]; then
+    echo "all tests passed"
+fi
+exit $failed